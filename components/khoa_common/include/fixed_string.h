@@ -0,0 +1,79 @@
+#ifndef _FIXED_STRING_H_
+#define _FIXED_STRING_H_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * FixedString<N> - Inline, bounded, NUL-terminated string of at most N bytes
+ *
+ * Lives entirely in the owning object (no heap), so copying one under a mutex
+ * or into an event payload never allocates. Input longer than N is truncated;
+ * assign() reports it. Converts implicitly to std::string_view and exposes
+ * c_str() so it drops into ESP-IDF C APIs and printf-style logging.
+ *
+ * Capacities follow the protocol/storage limits:
+ *   SsidString      32   (802.11 SSID)
+ *   PasswordString  64   (WPA passphrase 8..63, or 64 hex digit PSK)
+ *   UrlString       256  (config URLs in NVS)
+ */
+template <size_t N>
+class FixedString {
+public:
+    static constexpr size_t kCapacity = N;
+
+    FixedString() { data_[0] = '\0'; }
+    explicit FixedString(std::string_view value) { assign(value); }
+    explicit FixedString(const char* value) { assign(value ? std::string_view(value) : std::string_view()); }
+
+    FixedString& operator=(std::string_view value) { assign(value); return *this; }
+    FixedString& operator=(const char* value) { return *this = (value ? std::string_view(value) : std::string_view()); }
+    FixedString& operator=(const std::string& value) { return *this = std::string_view(value); }
+
+    // Returns false if the value had to be truncated
+    bool assign(std::string_view value) {
+        size_t length = value.size() < N ? value.size() : N;
+        memmove(data_, value.data(), length);
+        data_[length] = '\0';
+        length_ = length;
+        return length == value.size();
+    }
+
+    void clear() { data_[0] = '\0'; length_ = 0; }
+
+    const char* c_str() const { return data_; }
+    const char* data() const { return data_; }
+    size_t size() const { return length_; }
+    size_t length() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    static constexpr size_t capacity() { return N; }
+
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + length_; }
+    char operator[](size_t index) const { return data_[index]; }
+
+    std::string_view view() const { return std::string_view(data_, length_); }
+    operator std::string_view() const { return view(); }
+    std::string str() const { return std::string(data_, length_); }
+
+    friend bool operator==(const FixedString& a, const FixedString& b) { return a.view() == b.view(); }
+    friend bool operator==(const FixedString& a, std::string_view b) { return a.view() == b; }
+    friend bool operator==(std::string_view a, const FixedString& b) { return a == b.view(); }
+    friend bool operator!=(const FixedString& a, const FixedString& b) { return !(a == b); }
+    friend bool operator!=(const FixedString& a, std::string_view b) { return !(a == b); }
+    friend bool operator!=(std::string_view a, const FixedString& b) { return !(a == b); }
+
+private:
+    char data_[N + 1];
+    size_t length_ = 0;
+};
+
+using SsidString = FixedString<32>;
+using PasswordString = FixedString<64>;
+using UrlString = FixedString<256>;
+using IpAddressString = FixedString<15>;     // "255.255.255.255"
+using MacAddressString = FixedString<17>;    // "AA:BB:CC:DD:EE:FF"
+
+#endif // _FIXED_STRING_H_
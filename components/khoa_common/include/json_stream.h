@@ -0,0 +1,531 @@
+#ifndef _JSON_STREAM_H_
+#define _JSON_STREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include "fixed_string.h"
+
+/**
+ * JsonWriter - Streaming JSON writer over a caller-provided buffer
+ *
+ * Output is staged in `buffer`. With a sink, a full buffer is handed to the
+ * sink and reused (httpd_resp_send_chunk, a socket write...), so a document of
+ * any size costs only the buffer. Without a sink the buffer must hold the
+ * whole document and overflowing it fails the writer. Commas come from a
+ * nesting bitmask (kMaxDepth levels); strings are escaped while copied.
+ *
+ *     char buf[128];
+ *     JsonWriter json(buf, sizeof(buf), SendChunk, req);
+ *     json.BeginObject().Key("success").Bool(true).EndObject();
+ *     if (!json.Finish()) ...
+ */
+class JsonWriter {
+public:
+    // Returns false to abort the document (e.g. the peer went away)
+    using Sink = bool (*)(void* ctx, const char* data, size_t length);
+    static constexpr int kMaxDepth = 16;
+
+    JsonWriter(char* buffer, size_t size, Sink sink = nullptr, void* sink_ctx = nullptr)
+        : buffer_(buffer), size_(size), sink_(sink), sink_ctx_(sink_ctx) {}
+
+    JsonWriter& BeginObject() { return Open('{'); }
+    JsonWriter& EndObject() { return Close('}'); }
+    JsonWriter& BeginArray() { return Open('['); }
+    JsonWriter& EndArray() { return Close(']'); }
+
+    JsonWriter& Key(std::string_view key) {
+        Separate();
+        Quote(key);
+        Put(':');
+        after_key_ = true;
+        return *this;
+    }
+
+    JsonWriter& String(std::string_view value) {
+        Separate();
+        Quote(value);
+        return *this;
+    }
+
+    JsonWriter& Int(int64_t value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        Separate();
+        Write(digits, result.ptr - digits);
+        return *this;
+    }
+
+    JsonWriter& Bool(bool value) {
+        Separate();
+        Write(value ? std::string_view("true") : std::string_view("false"));
+        return *this;
+    }
+
+    JsonWriter& Null() {
+        Separate();
+        Write("null");
+        return *this;
+    }
+
+    // An already serialized value, written as-is
+    JsonWriter& Raw(std::string_view json) {
+        Separate();
+        Write(json);
+        return *this;
+    }
+
+    // Hands the rest to the sink. False if anything failed or a container is still open.
+    bool Finish() {
+        if (sink_ != nullptr && length_ > 0) {
+            Flush();
+        }
+        if (sink_ == nullptr && length_ < size_) {
+            buffer_[length_] = '\0';
+        }
+        return ok_ && depth_ == 0;
+    }
+
+    bool ok() const { return ok_; }
+    // Without a sink: the document so far
+    std::string_view View() const { return std::string_view(buffer_, length_); }
+
+private:
+    JsonWriter& Open(char bracket) {
+        Separate();
+        Put(bracket);
+        if (++depth_ >= kMaxDepth) {
+            ok_ = false;
+        } else {
+            has_items_ &= ~(1u << depth_);
+        }
+        return *this;
+    }
+
+    JsonWriter& Close(char bracket) {
+        if (depth_ == 0) {
+            ok_ = false;
+            return *this;
+        }
+        depth_--;
+        Put(bracket);
+        return *this;
+    }
+
+    // Comma before every item but the first of its container, none after a key
+    void Separate() {
+        if (after_key_) {
+            after_key_ = false;
+            return;
+        }
+        uint32_t bit = 1u << depth_;
+        if (has_items_ & bit) {
+            Put(',');
+        }
+        has_items_ |= bit;
+    }
+
+    void Quote(std::string_view text) {
+        static const char kHex[] = "0123456789abcdef";
+        Put('"');
+        size_t start = 0;
+        for (size_t i = 0; i < text.size(); i++) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            Write(text.substr(start, i - start));
+            start = i + 1;
+            switch (c) {
+                case '"':  Write("\\\""); break;
+                case '\\': Write("\\\\"); break;
+                case '\n': Write("\\n"); break;
+                case '\r': Write("\\r"); break;
+                case '\t': Write("\\t"); break;
+                default: {
+                    char escape[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xf]};
+                    Write(escape, sizeof(escape));
+                    break;
+                }
+            }
+        }
+        Write(text.substr(start));
+        Put('"');
+    }
+
+    void Put(char c) { Write(&c, 1); }
+    void Write(std::string_view text) { Write(text.data(), text.size()); }
+
+    void Write(const char* data, size_t length) {
+        while (ok_ && length > 0) {
+            if (length_ == size_) {
+                if (sink_ == nullptr) {
+                    ok_ = false;
+                    return;
+                }
+                Flush();
+                continue;
+            }
+            size_t chunk = length < size_ - length_ ? length : size_ - length_;
+            memcpy(buffer_ + length_, data, chunk);
+            length_ += chunk;
+            data += chunk;
+            length -= chunk;
+        }
+    }
+
+    void Flush() {
+        if (ok_ && !sink_(sink_ctx_, buffer_, length_)) {
+            ok_ = false;
+        }
+        length_ = 0;
+    }
+
+    char* buffer_;
+    size_t size_;
+    size_t length_ = 0;
+    Sink sink_;
+    void* sink_ctx_;
+    int depth_ = 0;
+    uint32_t has_items_ = 0;   // Bit n: the container at depth n has an item
+    bool after_key_ = false;
+    bool ok_ = true;
+};
+
+/**
+ * JsonReader - Pull parser walking a JSON text in place, no allocation
+ *
+ * Objects are read member by member with NextKey() (arrays with
+ * NextElement()); each value is then read straight into a caller variable
+ * (ReadString into a FixedString, ReadInt, ReadBool) or skipped. A value of
+ * another type is skipped and its read returns false, so an unexpected member
+ * doesn't end the walk; a syntax error does: every call fails from then on
+ * and ok() is false. Skipped values are scanned, not fully validated.
+ * Keys are compared raw, without decoding escapes.
+ *
+ *     JsonReader json(body);
+ *     std::string_view key;
+ *     if (json.EnterObject()) {
+ *         while (json.NextKey(key)) {
+ *             if (key == "ssid") json.ReadString(ssid);
+ *             else json.SkipValue();
+ *         }
+ *     }
+ *     if (!json.ok()) ...
+ */
+class JsonReader {
+public:
+    static constexpr int kMaxDepth = 32;
+
+    explicit JsonReader(std::string_view text) : pos_(text.data()), end_(text.data() + text.size()) {}
+
+    bool ok() const { return !error_; }
+
+    // True if the next value is an object, now entered; any other value is skipped
+    bool EnterObject() { return Enter('{'); }
+    bool EnterArray() { return Enter('['); }
+
+    // Next member of the entered object, false once its '}' is consumed
+    bool NextKey(std::string_view& key) {
+        if (!NextItem('}')) {
+            return false;
+        }
+        if (Peek() != '"') {
+            return Fail();
+        }
+        const char* start = pos_ + 1;
+        if (!ScanString([](char) {})) {
+            return false;
+        }
+        key = std::string_view(start, pos_ - 1 - start);
+        if (Peek() != ':') {
+            return Fail();
+        }
+        pos_++;
+        return true;
+    }
+
+    // Next element of the entered array, false once its ']' is consumed
+    bool NextElement() { return NextItem(']'); }
+
+    template <size_t N>
+    bool ReadString(FixedString<N>& out, bool* truncated = nullptr) {
+        char decoded[N];
+        size_t length = 0;
+        bool overflow = false;
+        if (!ReadStringWith([&](char c) {
+                if (length < N) {
+                    decoded[length++] = c;
+                } else {
+                    overflow = true;
+                }
+            })) {
+            return false;
+        }
+        out.assign(std::string_view(decoded, length));
+        if (truncated != nullptr) {
+            *truncated = overflow;
+        }
+        return true;
+    }
+
+    bool ReadString(std::string& out) {
+        std::string decoded;
+        if (!ReadStringWith([&decoded](char c) { decoded += c; })) {
+            return false;
+        }
+        out = std::move(decoded);
+        return true;
+    }
+
+    // Integers; a fraction is truncated. False if out of range for T.
+    template <typename T>
+    bool ReadInt(T& out) {
+        if (Peek() != '-' && (Peek() < '0' || Peek() > '9')) {
+            SkipValue();
+            return false;
+        }
+        const char* start = pos_;
+        while (pos_ < end_ && IsNumberChar(*pos_)) {
+            pos_++;
+        }
+        int64_t value = 0;
+        auto result = std::from_chars(start, pos_, value);
+        if (result.ec == std::errc::invalid_argument) {
+            return Fail();
+        }
+        if (result.ec != std::errc()) {
+            return false;   // Out of int64_t range
+        }
+        if (result.ptr != pos_) {
+            double real = 0;
+            auto real_result = std::from_chars(start, pos_, real);
+            if (real_result.ec != std::errc() || real_result.ptr != pos_) {
+                return Fail();
+            }
+            value = static_cast<int64_t>(real);
+        }
+        if (value < static_cast<int64_t>(std::numeric_limits<T>::min()) ||
+            value > static_cast<int64_t>(std::numeric_limits<T>::max())) {
+            return false;
+        }
+        out = static_cast<T>(value);
+        return true;
+    }
+
+    bool ReadBool(bool& out) {
+        if (Literal("true")) {
+            out = true;
+            return true;
+        }
+        if (Literal("false")) {
+            out = false;
+            return true;
+        }
+        SkipValue();
+        return false;
+    }
+
+    bool SkipValue() {
+        int nesting = 0;
+        do {
+            char c = Peek();
+            if (c == '\0') {
+                return Fail();
+            } else if (c == '"') {
+                if (!ScanString([](char) {})) {
+                    return false;
+                }
+            } else if (c == '{' || c == '[') {
+                nesting++;
+                pos_++;
+            } else if (c == '}' || c == ']' || c == ',' || c == ':') {
+                if (nesting == 0) {
+                    return Fail();
+                }
+                if (c == '}' || c == ']') {
+                    nesting--;
+                }
+                pos_++;
+            } else {
+                const char* start = pos_;
+                while (pos_ < end_ && (IsNumberChar(*pos_) || (*pos_ >= 'a' && *pos_ <= 'z'))) {
+                    pos_++;
+                }
+                if (pos_ == start) {
+                    return Fail();
+                }
+            }
+        } while (nesting > 0);
+        return true;
+    }
+
+private:
+    static bool IsNumberChar(char c) {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+    }
+
+    // Next significant character, '\0' at the end or after an error
+    char Peek() {
+        while (!error_ && pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\n' || *pos_ == '\r')) {
+            pos_++;
+        }
+        return (error_ || pos_ == end_) ? '\0' : *pos_;
+    }
+
+    bool Fail() {
+        error_ = true;
+        return false;
+    }
+
+    bool Literal(std::string_view word) {
+        Peek();
+        if (error_ || static_cast<size_t>(end_ - pos_) < word.size() ||
+            std::string_view(pos_, word.size()) != word) {
+            return false;
+        }
+        pos_ += word.size();
+        return true;
+    }
+
+    bool Enter(char bracket) {
+        if (Peek() != bracket) {
+            SkipValue();
+            return false;
+        }
+        if (depth_ + 1 >= kMaxDepth) {
+            return Fail();
+        }
+        pos_++;
+        depth_++;
+        not_first_ &= ~(1u << depth_);
+        return true;
+    }
+
+    // Consumes the separator before an item, or the closing bracket
+    bool NextItem(char bracket) {
+        if (depth_ == 0) {
+            return Fail();
+        }
+        char c = Peek();
+        if (c == bracket) {
+            pos_++;
+            depth_--;
+            return false;
+        }
+        uint32_t bit = 1u << depth_;
+        if (not_first_ & bit) {
+            if (c != ',') {
+                return Fail();
+            }
+            pos_++;
+        }
+        not_first_ |= bit;
+        return !error_;
+    }
+
+    template <typename Append>
+    bool ReadStringWith(Append&& append) {
+        if (Peek() != '"') {
+            SkipValue();
+            return false;
+        }
+        return ScanString(append);
+    }
+
+    // At the opening quote: decodes up to and past the closing one
+    template <typename Append>
+    bool ScanString(Append&& append) {
+        pos_++;
+        while (pos_ < end_) {
+            unsigned char c = static_cast<unsigned char>(*pos_++);
+            if (c == '"') {
+                return true;
+            }
+            if (c < 0x20) {
+                return Fail();
+            }
+            if (c != '\\') {
+                append(static_cast<char>(c));
+                continue;
+            }
+            if (pos_ == end_) {
+                break;
+            }
+            switch (*pos_++) {
+                case '"':  append('"'); break;
+                case '\\': append('\\'); break;
+                case '/':  append('/'); break;
+                case 'b':  append('\b'); break;
+                case 'f':  append('\f'); break;
+                case 'n':  append('\n'); break;
+                case 'r':  append('\r'); break;
+                case 't':  append('\t'); break;
+                case 'u': {
+                    uint32_t code = 0;
+                    if (!ReadHex4(code)) {
+                        return Fail();
+                    }
+                    // Surrogate pair
+                    if (code >= 0xd800 && code < 0xdc00 && end_ - pos_ >= 6 && pos_[0] == '\\' && pos_[1] == 'u') {
+                        pos_ += 2;
+                        uint32_t low = 0;
+                        if (!ReadHex4(low) || low < 0xdc00 || low >= 0xe000) {
+                            return Fail();
+                        }
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    AppendUtf8(code, append);
+                    break;
+                }
+                default:
+                    return Fail();
+            }
+        }
+        return Fail();
+    }
+
+    bool ReadHex4(uint32_t& code) {
+        if (end_ - pos_ < 4) {
+            return false;
+        }
+        auto result = std::from_chars(pos_, pos_ + 4, code, 16);
+        if (result.ptr != pos_ + 4) {
+            return false;
+        }
+        pos_ += 4;
+        return true;
+    }
+
+    template <typename Append>
+    static void AppendUtf8(uint32_t code, Append&& append) {
+        if (code < 0x80) {
+            append(static_cast<char>(code));
+        } else if (code < 0x800) {
+            append(static_cast<char>(0xc0 | (code >> 6)));
+            append(static_cast<char>(0x80 | (code & 0x3f)));
+        } else if (code < 0x10000) {
+            append(static_cast<char>(0xe0 | (code >> 12)));
+            append(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+            append(static_cast<char>(0x80 | (code & 0x3f)));
+        } else {
+            append(static_cast<char>(0xf0 | (code >> 18)));
+            append(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+            append(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+            append(static_cast<char>(0x80 | (code & 0x3f)));
+        }
+    }
+
+    const char* pos_;
+    const char* end_;
+    int depth_ = 0;
+    uint32_t not_first_ = 0;   // Bit n: the container at depth n already had an item
+    bool error_ = false;
+};
+
+#endif // _JSON_STREAM_H_
@@ -0,0 +1,105 @@
+/*
+ * Asset Bundle - Map + kiểm tra gói tài nguyên web trong phân vùng storage
+ * Dữ liệu được đọc thẳng từ flash qua mmap, chỉ nạp khi crc32 và bảng entry hợp lệ
+ */
+
+#include "asset_bundle.h"
+#include <cinttypes>
+#include <cstring>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "AssetBundle";
+
+AssetBundle& AssetBundle::GetInstance() {
+    static AssetBundle instance;
+    return instance;
+}
+
+AssetBundle::~AssetBundle() {
+    Unload();
+}
+
+const esp_partition_t* AssetBundle::FindPartition() {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, kPartitionLabel);
+}
+
+esp_err_t AssetBundle::Load() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (header_ != nullptr) return ESP_OK;
+
+    const esp_partition_t* partition = FindPartition();
+    if (partition == nullptr) return ESP_ERR_NOT_FOUND;
+
+    AssetBundleHeader header;
+    esp_err_t err = esp_partition_read(partition, 0, &header, sizeof(header));
+    if (err != ESP_OK) return err;
+    if (header.magic != kAssetBundleMagic) return ESP_ERR_NOT_FOUND;    // Trống (0xFF) hoặc chưa ghi xong
+    if (header.format != kAssetBundleFormat || header.version == 0) {
+        ESP_LOGW(TAG, "Bundle khong ho tro: format %u, version %" PRIu32, header.format, header.version);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (header.length > partition->size - sizeof(header)) {
+        ESP_LOGW(TAG, "Bundle %" PRIu32 " bytes lon hon phan vung %s", header.length, partition->label);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const void* mapped = nullptr;
+    esp_partition_mmap_handle_t handle;
+    err = esp_partition_mmap(partition, 0, sizeof(header) + header.length, ESP_PARTITION_MMAP_DATA, &mapped, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_partition_mmap that bai: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const auto* bundle = static_cast<const AssetBundleHeader*>(mapped);
+    err = Validate(bundle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Bundle v%" PRIu32 " hong (%s), dung ban nhung", bundle->version, esp_err_to_name(err));
+        esp_partition_munmap(handle);
+        return err;
+    }
+
+    header_ = bundle;
+    mmap_handle_ = handle;
+    ESP_LOGI(TAG, "Bundle v%" PRIu32 ": %u asset, %" PRIu32 " bytes (%s)",
+             bundle->version, bundle->count, bundle->length, partition->label);
+    return ESP_OK;
+}
+
+void AssetBundle::Unload() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (header_ == nullptr) return;
+    esp_partition_munmap(mmap_handle_);
+    header_ = nullptr;
+    mmap_handle_ = 0;
+}
+
+uint32_t AssetBundle::GetVersion() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return header_ ? header_->version : 0;
+}
+
+/// Mọi offset/độ dài đều được kiểm tra trước khi Use() trả con trỏ vào vùng map
+esp_err_t AssetBundle::Validate(const AssetBundleHeader* header) {
+    const uint8_t* body = reinterpret_cast<const uint8_t*>(header + 1);
+    if (esp_rom_crc32_le(0, body, header->length) != header->crc32) return ESP_ERR_INVALID_CRC;
+
+    size_t size = sizeof(*header) + header->length;
+    size_t data_start = sizeof(*header) + (size_t)header->count * sizeof(AssetBundleEntry);
+    if (header->count == 0 || data_start > size) return ESP_ERR_INVALID_SIZE;
+
+    const auto* entries = reinterpret_cast<const AssetBundleEntry*>(body);
+    for (uint16_t i = 0; i < header->count; i++) {
+        const AssetBundleEntry& entry = entries[i];
+        if (strnlen(entry.uri, sizeof(entry.uri)) == sizeof(entry.uri) || entry.uri[0] != '/' ||
+            strnlen(entry.content_type, sizeof(entry.content_type)) == sizeof(entry.content_type) ||
+            strnlen(entry.etag, sizeof(entry.etag)) == sizeof(entry.etag)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (entry.offset < data_start || entry.offset > size || entry.length > size - entry.offset) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    return ESP_OK;
+}
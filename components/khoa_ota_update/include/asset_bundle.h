@@ -0,0 +1,108 @@
+/*
+ * Asset Bundle - Gói tài nguyên web (trang cấu hình...) trong phân vùng `storage`
+ * Sửa giao diện chỉ cần OTA vài KB thay vì cả firmware:
+ *   gen_portal_assets.py --bundle assets.bin --version N ...  → OtaManager tải về storage
+ *   → trang cấu hình phục vụ bản trong bundle, không có / hỏng thì dùng bản nhúng trong firmware
+ *
+ * Bố cục (little endian), bắt đầu ở offset 0 của phân vùng:
+ *   AssetBundleHeader
+ *   count × AssetBundleEntry
+ *   dữ liệu gzip của từng asset (offset tính từ đầu bundle, căn 4 byte)
+ * crc32 phủ toàn bộ phần sau header. Header được ghi sau cùng: bundle ghi dở không có magic.
+ */
+
+#ifndef _ASSET_BUNDLE_H_
+#define _ASSET_BUNDLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+static constexpr uint32_t kAssetBundleMagic = 0x4241504B;   // "KPAB"
+static constexpr uint16_t kAssetBundleFormat = 1;
+
+struct AssetBundleHeader {
+    uint32_t magic;
+    uint16_t format;
+    uint16_t count;         // Số asset
+    uint32_t version;       // Phiên bản bundle (tăng dần, > 0)
+    uint32_t length;        // Số byte sau header
+    uint32_t crc32;         // esp_rom_crc32_le(0, ...) của phần sau header
+};
+static_assert(sizeof(AssetBundleHeader) == 20, "Layout dùng chung với gen_portal_assets.py");
+
+struct AssetBundleEntry {
+    char uri[32];           // Các chuỗi đều kết thúc bằng '\0'
+    char content_type[32];
+    char etag[20];
+    uint32_t offset;
+    uint32_t length;
+};
+static_assert(sizeof(AssetBundleEntry) == 92, "Layout dùng chung với gen_portal_assets.py");
+
+/// Singleton đọc bundle qua mmap (không chép vào RAM) — thread-safe
+class AssetBundle {
+public:
+    static constexpr const char* kPartitionLabel = "storage";
+
+    struct Asset {
+        const char* uri;
+        const char* content_type;
+        const uint8_t* data;    // gzip
+        size_t length;
+        const char* etag;
+    };
+
+    static AssetBundle& GetInstance();
+
+    /// Phân vùng chứa bundle, nullptr nếu bảng phân vùng không có `storage`
+    static const esp_partition_t* FindPartition();
+
+    /// Map + kiểm tra bundle trong storage (gọi lại khi đã nạp thì bỏ qua)
+    /// ESP_ERR_NOT_FOUND: không có bundle, ESP_ERR_INVALID_CRC / ESP_ERR_INVALID_VERSION: bundle hỏng
+    esp_err_t Load();
+    /// Bỏ map (trước khi ghi đè phân vùng)
+    void Unload();
+
+    /// Phiên bản bundle đang nạp, 0 nếu không có
+    uint32_t GetVersion() const;
+
+    /// Tìm asset theo URI trong bundle có version > min_version rồi gọi fn(asset).
+    /// Khóa được giữ trong lúc fn chạy nên dữ liệu không bị ghi đè giữa chừng.
+    /// Trả về false nếu không có (caller dùng bản nhúng).
+    template <typename Fn>
+    bool Use(std::string_view uri, uint32_t min_version, Fn&& fn) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (header_ == nullptr || header_->version <= min_version) return false;
+        const auto* entries = reinterpret_cast<const AssetBundleEntry*>(header_ + 1);
+        for (uint16_t i = 0; i < header_->count; i++) {
+            if (uri == entries[i].uri) {
+                const uint8_t* base = reinterpret_cast<const uint8_t*>(header_);
+                fn(Asset{entries[i].uri, entries[i].content_type, base + entries[i].offset,
+                         entries[i].length, entries[i].etag});
+                return true;
+            }
+        }
+        return false;
+    }
+
+    AssetBundle(const AssetBundle&) = delete;
+    AssetBundle& operator=(const AssetBundle&) = delete;
+
+private:
+    AssetBundle() = default;
+    ~AssetBundle();
+
+    /// Kiểm tra bảng entry + crc32 của bundle đã map
+    static esp_err_t Validate(const AssetBundleHeader* header);
+
+    mutable std::mutex mutex_;
+    const AssetBundleHeader* header_ = nullptr;     // Vùng đã map, nullptr khi chưa nạp
+    esp_partition_mmap_handle_t mmap_handle_ = 0;
+};
+
+#endif // _ASSET_BUNDLE_H_
@@ -10,11 +10,14 @@
 #define _OTA_MANAGER_H_
 
 #include <string>
+#include <string_view>
 #include <functional>
 #include <mutex>
 
 #include "esp_err.h"
 #include "esp_ota_ops.h"
+#include "esp_app_format.h"
+#include "fixed_string.h"
 
 // Trạng thái OTA
 enum class OtaState {
@@ -38,13 +41,15 @@ struct OtaProgress {
 // Thông tin phiên bản từ server
 struct VersionInfo {
     std::string version;        // Phiên bản mới nhất
-    std::string firmware_url;   // URL download firmware
+    UrlString firmware_url;     // URL download firmware
     bool force = false;         // Bắt buộc cập nhật
+    uint32_t assets_version = 0;    // Phiên bản giao diện web (asset bundle), 0 = server không có
+    UrlString assets_url;           // URL download asset bundle
 };
 
 // Cấu hình OTA
 struct OtaConfig {
-    std::string url;                        // URL server (VD: http://192.168.1.2:8080)
+    UrlString url;                          // URL server (VD: http://192.168.1.2:8080), tối đa 256 ký tự
     std::string cert_pem;                   // Chứng chỉ CA cho HTTPS (rỗng = bundle mặc định)
     int timeout_ms = 60000;                 // Timeout kết nối (ms)
     size_t buffer_size = 4096;              // Buffer đọc firmware (bytes)
@@ -58,12 +63,12 @@ public:
     static OtaManager& GetInstance();
 
     /// Kiểm tra OTA 1 lần khi boot (tự xử lý rollback + ghép URL + tạo task)
-    void CheckOnBoot(const std::string& server_input);
+    void CheckOnBoot(std::string_view server_input);
 
     /// Khởi tạo cấu hình chi tiết
     void Initialize(const OtaConfig& config);
     bool IsInitialized() const;
-    void SetUrl(const std::string& url);
+    void SetUrl(std::string_view url);
 
     /// Bắt đầu cập nhật OTA (BLOCKING): FetchVersion → Download
     esp_err_t StartUpdate();
@@ -82,6 +87,22 @@ public:
     void Restart();
     void SetProgressCallback(std::function<void(const OtaProgress&)> callback);
 
+    /// Báo hiệu bắt đầu/kết thúc tải firmware (true/false) để app tắt power save WiFi
+    /// VD: SetTransferCallback([](bool on) { on ? wifi.BeginTransfer() : wifi.EndTransfer(); });
+    void SetTransferCallback(std::function<void(bool active)> callback);
+
+    /// Ghi firmware do nguồn ngoài đẩy vào (VD: upload qua trang cấu hình WiFi), không cần server:
+    /// BeginWrite(tổng byte) → Write(...) từng phần → EndWrite() (xác minh + đặt boot), lỗi thì AbortWrite().
+    /// Dùng chung đường ghi với PerformOta; image phải cùng project_name với firmware đang chạy.
+    esp_err_t BeginWrite(size_t total_bytes);
+    esp_err_t Write(const void* data, size_t length);
+    esp_err_t EndWrite();
+    void AbortWrite();
+
+    /// Chỉ cập nhật giao diện web (asset bundle, vài KB) vào phân vùng storage (BLOCKING).
+    /// Không cần khởi động lại; StartUpdate() tự gọi khi firmware đã mới nhất mà server có bundle mới hơn.
+    esp_err_t UpdateAssets(std::string_view url);
+
     OtaManager(const OtaManager&) = delete;
     OtaManager& operator=(const OtaManager&) = delete;
 
@@ -93,21 +114,42 @@ private:
     esp_err_t FetchVersionInfo(VersionInfo& out_info);
     /// Bước 2: Tải và ghi firmware OTA
     esp_err_t PerformOta();
+    /// Tải asset bundle vào storage (đã ở trạng thái Checking/Downloading)
+    esp_err_t PerformAssetUpdate(const UrlString& url);
+
+    /// Đường ghi dùng chung: mở phân vùng đích / hủy phần đã ghi
+    esp_err_t OpenWrite(const esp_partition_t* partition, size_t total_bytes, bool external);
+    void DiscardWrite();
+    /// Kiểm tra esp_app_desc_t trong header image (upload: tránh nạp nhầm firmware project khác)
+    esp_err_t CheckImageHeader() const;
+    void NotifyTransfer(bool active);
 
     /// Gửi thông báo tiến trình
     void NotifyProgress(OtaState state, int percent, size_t downloaded,
                         size_t total, const std::string& msg);
 
     /// Ghép URL từ IP/domain
-    static std::string BuildBaseUrl(const std::string& input);
+    static UrlString BuildBaseUrl(std::string_view input);
 
     OtaConfig config_;
     OtaState state_ = OtaState::Idle;
     bool initialized_ = false;
     bool abort_requested_ = false;
 
+    // Phiên ghi hiện tại: chỉ task đang ghi (PerformOta hoặc nguồn upload) truy cập
+    static constexpr size_t kImageHeaderSize =
+        sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
+    esp_ota_handle_t write_handle_ = 0;
+    const esp_partition_t* write_partition_ = nullptr;
+    size_t write_total_ = 0;
+    size_t write_done_ = 0;
+    size_t write_notified_ = 0;         // % (có Content-Length) hoặc byte (không có) đã báo lần cuối
+    bool write_external_ = false;       // Mở bằng BeginWrite: kiểm tra project, đã gọi transfer callback(true)
+    uint8_t image_header_[kImageHeaderSize];
+
     mutable std::mutex mutex_;
     std::function<void(const OtaProgress&)> progress_callback_;
+    std::function<void(bool active)> transfer_callback_;
 };
 
 // ============================================================================
@@ -125,7 +167,7 @@ private:
 #include "esp_http_client.h"
 #include "esp_chip_info.h"
 #include "esp_flash.h"
-#include "cJSON.h"
+#include "json_stream.h"
 #include "esp_mac.h"
 
 extern "C" esp_err_t esp_crt_bundle_attach(void *conf);
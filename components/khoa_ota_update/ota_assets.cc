@@ -0,0 +1,167 @@
+/*
+ * OTA Assets - Cập nhật riêng giao diện web (asset bundle) vào phân vùng storage
+ * Tải bundle (vài chục KB) → xóa + ghi từng sector → ghi header sau cùng → nạp lại (kiểm tra crc32)
+ * Không đụng tới phân vùng app, không cần khởi động lại
+ */
+
+#include "ota_manager.h"
+#include "asset_bundle.h"
+#include <algorithm>
+
+static const char *TAG = "OTA";
+
+static constexpr size_t kAssetBufferSize = 4096;
+static constexpr size_t kFlashSectorSize = 4096;
+
+/// Tải asset bundle từ url rồi ghi vào storage (BLOCKING)
+esp_err_t OtaManager::UpdateAssets(std::string_view url) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (url.empty()) return ESP_ERR_INVALID_ARG;
+        if (state_ != OtaState::Idle && state_ != OtaState::Failed) return ESP_ERR_INVALID_STATE;
+        abort_requested_ = false;
+        state_ = OtaState::Downloading;
+    }
+    return PerformAssetUpdate(UrlString(url));
+}
+
+esp_err_t OtaManager::PerformAssetUpdate(const UrlString& url) {
+    const esp_partition_t *partition = AssetBundle::FindPartition();
+    if (partition == nullptr) {
+        ESP_LOGE(TAG, "Khong co phan vung %s cho giao dien!", AssetBundle::kPartitionLabel);
+        NotifyProgress(OtaState::Failed, 0, 0, 0, "Khong co phan vung storage!");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    NotifyProgress(OtaState::Downloading, 0, 0, 0, "Dang tai giao dien...");
+
+    esp_http_client_config_t http_config = {};
+    http_config.url = url.c_str();
+    http_config.timeout_ms = config_.timeout_ms;
+    http_config.max_redirection_count = 3;
+    configure_ssl(http_config, config_.cert_pem);
+
+    esp_http_client_handle_t client = esp_http_client_init(&http_config);
+    if (client == nullptr) {
+        NotifyProgress(OtaState::Failed, 0, 0, 0, "Khong the khoi tao HTTP client!");
+        return ESP_FAIL;
+    }
+    esp_http_client_set_header(client, "Device-Id", GetMacString().c_str());
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Khong the ket noi server giao dien: %s", esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        NotifyProgress(OtaState::Failed, 0, 0, 0, "Khong the ket noi server!");
+        return err;
+    }
+
+    int content_length = esp_http_client_fetch_headers(client);
+    int status_code = esp_http_client_get_status_code(client);
+    size_t total_bytes = (content_length > 0) ? (size_t)content_length : 0;
+    if (status_code != 200 || total_bytes > partition->size) {
+        ESP_LOGE(TAG, "Bundle: HTTP %d, %d bytes (phan vung %" PRIu32 " bytes)",
+                 status_code, content_length, partition->size);
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        NotifyProgress(OtaState::Failed, 0, 0, total_bytes, "Server tra ve loi HTTP!");
+        return status_code != 200 ? ESP_FAIL : ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *buffer = (uint8_t *)malloc(kAssetBufferSize);
+    if (buffer == nullptr) {
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        NotifyProgress(OtaState::Failed, 0, 0, total_bytes, "Loi cap phat bo nho!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Trang cấu hình quay về bản nhúng trong lúc phân vùng bị ghi đè
+    AssetBundle::GetInstance().Unload();
+    NotifyTransfer(true);
+
+    // Header giữ trong RAM và ghi sau cùng: mất điện giữa chừng chỉ để lại vùng không có magic
+    AssetBundleHeader header = {};
+    size_t received = 0;
+    size_t erased = 0;
+    while (err == ESP_OK) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (abort_requested_) {
+                err = ESP_ERR_INVALID_STATE;
+                break;
+            }
+        }
+
+        int read_len = esp_http_client_read(client, (char *)buffer, kAssetBufferSize);
+        if (read_len < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        if (read_len == 0) {
+            if (!esp_http_client_is_complete_data_received(client)) err = ESP_FAIL;
+            break;
+        }
+
+        const uint8_t *data = buffer;
+        size_t length = read_len;
+        if (received < sizeof(header)) {
+            size_t n = std::min(length, sizeof(header) - received);
+            memcpy(reinterpret_cast<uint8_t *>(&header) + received, data, n);
+            data += n;
+            length -= n;
+            received += n;
+        }
+        if (received + length > partition->size) {
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        while (err == ESP_OK && erased < received + length) {
+            err = esp_partition_erase_range(partition, erased, kFlashSectorSize);
+            erased += kFlashSectorSize;
+        }
+        if (err == ESP_OK && length > 0) {
+            err = esp_partition_write(partition, received, data, length);
+            received += length;
+        }
+    }
+
+    free(buffer);
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+
+    if (err == ESP_OK && (received < sizeof(header) || header.magic != kAssetBundleMagic ||
+                          header.length != received - sizeof(header))) {
+        ESP_LOGE(TAG, "Bundle khong hop le (%zu bytes)", received);
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    if (err == ESP_OK && erased == 0) {
+        err = esp_partition_erase_range(partition, 0, kFlashSectorSize);
+    }
+    if (err == ESP_OK) {
+        NotifyProgress(OtaState::Verifying, 100, received, total_bytes, "Dang xac minh giao dien...");
+        err = esp_partition_write(partition, 0, &header, sizeof(header));
+    }
+    if (err == ESP_OK && (err = AssetBundle::GetInstance().Load()) != ESP_OK) {
+        // Sai crc32 / bảng entry: xóa header để lần boot sau không thử lại bundle này
+        esp_partition_erase_range(partition, 0, kFlashSectorSize);
+    }
+    NotifyTransfer(false);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cap nhat giao dien that bai: %s", esp_err_to_name(err));
+        AssetBundle::GetInstance().Load();     // Bundle cũ nếu chưa bị xóa, không thì bản nhúng
+        if (err == ESP_ERR_INVALID_STATE) {
+            NotifyProgress(OtaState::Idle, 0, received, total_bytes, "Da huy cap nhat!");
+        } else if (err == ESP_FAIL) {
+            NotifyProgress(OtaState::Failed, 0, received, total_bytes, "Ket noi bi ngat!");
+        } else {
+            NotifyProgress(OtaState::Failed, 0, received, total_bytes, "Giao dien khong hop le!");
+        }
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Assets Updated: v%" PRIu32 " (%zu bytes)", header.version, received);
+    NotifyProgress(OtaState::Idle, 100, received, total_bytes, "Cap nhat giao dien thanh cong!");
+    return ESP_OK;
+}
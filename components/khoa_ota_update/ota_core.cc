@@ -3,6 +3,7 @@
  */
 
 #include "ota_manager.h"
+#include "asset_bundle.h"
 
 static const char *TAG = "OTA";
 
@@ -32,7 +33,7 @@ bool OtaManager::IsInitialized() const {
 }
 
 /// Cập nhật URL khi đang Idle/Failed
-void OtaManager::SetUrl(const std::string& url) {
+void OtaManager::SetUrl(std::string_view url) {
     std::lock_guard<std::mutex> lock(mutex_);
     if (state_ != OtaState::Idle && state_ != OtaState::Failed) return;
     config_.url = url;
@@ -105,6 +106,11 @@ void OtaManager::SetProgressCallback(std::function<void(const OtaProgress&)> cal
     progress_callback_ = callback;
 }
 
+void OtaManager::SetTransferCallback(std::function<void(bool active)> callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    transfer_callback_ = callback;
+}
+
 /// Cập nhật state + gọi callback
 void OtaManager::NotifyProgress(OtaState state, int percent, size_t downloaded,
                                  size_t total, const std::string& msg) {
@@ -119,7 +125,7 @@ void OtaManager::NotifyProgress(OtaState state, int percent, size_t downloaded,
 
 // ==================== StartUpdate: 2 bước ====================
 
-/// Bước 1: FetchVersion → Bước 2: PerformOta
+/// Bước 1: FetchVersion → Bước 2: PerformOta (hoặc PerformAssetUpdate nếu chỉ giao diện web mới)
 esp_err_t OtaManager::StartUpdate() {
     {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -157,6 +163,12 @@ esp_err_t OtaManager::StartUpdate() {
         ESP_LOGW(TAG, "Force Update: %s -> %s", cur.c_str(), info.version.c_str());
     } else {
         if (CompareVersion(info.version, cur) <= 0 && !config_.skip_version_check) {
+            // Firmware đã mới nhất nhưng giao diện web có thể đã sửa: chỉ tải asset bundle
+            uint32_t assets_version = AssetBundle::GetInstance().GetVersion();
+            if (info.assets_version > assets_version && !info.assets_url.empty()) {
+                ESP_LOGI(TAG, "New Assets Found: v%" PRIu32 " -> v%" PRIu32, assets_version, info.assets_version);
+                return PerformAssetUpdate(info.assets_url);
+            }
             ESP_LOGI(TAG, "Already up to date (%s)", cur.c_str());
             NotifyProgress(OtaState::Idle, 0, 0, 0, "Da la moi nhat!");
             std::lock_guard<std::mutex> lock(mutex_);
@@ -193,21 +205,23 @@ esp_err_t OtaManager::StartUpdate() {
 // ==================== BuildBaseUrl ====================
 
 /// IP → http://IP:8080 | Domain → https://domain | URL đầy đủ → giữ nguyên
-std::string OtaManager::BuildBaseUrl(const std::string& input) {
-    if (input.empty()) return "";
-    if (input.find("http") != std::string::npos) return input;
+UrlString OtaManager::BuildBaseUrl(std::string_view input) {
+    if (input.empty()) return UrlString();
+    if (input.find("http") != std::string_view::npos) return UrlString(input);
 
     bool is_ip = true;
     for (char c : input) {
         if (!isdigit(c) && c != '.') { is_ip = false; break; }
     }
-    return is_ip ? ("http://" + input + ":8080") : ("https://" + input);
+    char url[UrlString::kCapacity + 1];
+    snprintf(url, sizeof(url), is_ip ? "http://%.*s:8080" : "https://%.*s", (int)input.size(), input.data());
+    return UrlString(url);
 }
 
 // ==================== CheckOnBoot ====================
 
 /// Kiểm tra OTA 1 lần khi boot: rollback + ghép URL + tạo task
-void OtaManager::CheckOnBoot(const std::string& server_input) {
+void OtaManager::CheckOnBoot(std::string_view server_input) {
     // Tắt các log nhiễu từ WiFi và Certificate Bundle
     esp_log_level_set("wifi", ESP_LOG_WARN);
     esp_log_level_set("esp-x509-crt-bundle", ESP_LOG_WARN);
@@ -223,7 +237,7 @@ void OtaManager::CheckOnBoot(const std::string& server_input) {
     ESP_LOGI(TAG, "Partition: %s | Current Ver: %s",
              ota.GetRunningPartitionInfo().c_str(), ota.GetCurrentVersion().c_str());
 
-    std::string base_url = BuildBaseUrl(server_input);
+    UrlString base_url = BuildBaseUrl(server_input);
     if (base_url.empty()) { ESP_LOGW(TAG, "URL OTA rong, bo qua."); return; }
 
     OtaConfig cfg;
@@ -243,19 +257,15 @@ void OtaManager::CheckOnBoot(const std::string& server_input) {
         }
     });
 
-    // Tạo task OTA
-    auto* url_copy = new std::string(base_url);
+    // Tạo task OTA (URL đã nằm trong config_, không cần truyền qua tham số)
     auto task_fn = [](void* arg) {
-        auto* url = static_cast<std::string*>(arg);
         esp_err_t ret = OtaManager::GetInstance().StartUpdate();
         if (ret == ESP_ERR_INVALID_VERSION) ESP_LOGI(TAG, "Up to date! No need to update.");
         else if (ret != ESP_OK) ESP_LOGW(TAG, "Error: %s", esp_err_to_name(ret));
-        delete url;
         vTaskDelete(NULL);
     };
 
-    if (xTaskCreate(task_fn, "ota_boot", 8192, url_copy, 5, NULL) != pdPASS) {
+    if (xTaskCreate(task_fn, "ota_boot", 8192, NULL, 5, NULL) != pdPASS) {
         ESP_LOGE(TAG, "Tao task OTA that bai!");
-        delete url_copy;
     }
 }
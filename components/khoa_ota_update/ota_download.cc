@@ -8,10 +8,25 @@
 
 static const char *TAG = "OTA";
 
+/// Gọi transfer callback true khi vào, false khi ra khỏi phạm vi (mọi nhánh return)
+struct TransferScope {
+    std::function<void(bool)> cb;
+    explicit TransferScope(std::function<void(bool)> c) : cb(std::move(c)) { if (cb) cb(true); }
+    ~TransferScope() { if (cb) cb(false); }
+};
+
 /// Thực hiện tải và ghi firmware OTA nội bộ (Bước 3)
 esp_err_t OtaManager::PerformOta() {
     esp_err_t err;
 
+    // Báo app đang tải lớn (WiFi chuyển sang PERFORMANCE để tăng tốc độ)
+    std::function<void(bool)> transfer_cb;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        transfer_cb = transfer_callback_;
+    }
+    TransferScope transfer(std::move(transfer_cb));
+
     // === Kiểm tra phân vùng đích ===
     NotifyProgress(OtaState::Downloading, 0, 0, 0, "Dang kiem tra phan vung...");
 
@@ -66,10 +81,9 @@ esp_err_t OtaManager::PerformOta() {
     }
 
     // === Bắt đầu ghi OTA ===
-    esp_ota_handle_t ota_handle = 0;
-    err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+    size_t total_bytes = (content_length > 0) ? (size_t)content_length : 0;
+    err = OpenWrite(update_partition, total_bytes, false);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_begin that bai: %s", esp_err_to_name(err));
         esp_http_client_close(client);
         esp_http_client_cleanup(client);
         NotifyProgress(OtaState::Failed, 0, 0, 0, "Khong the bat dau ghi OTA!");
@@ -77,9 +91,7 @@ esp_err_t OtaManager::PerformOta() {
     }
 
     // === Tải và ghi firmware từng phần ===
-    size_t total_bytes = (content_length > 0) ? (size_t)content_length : 0;
     size_t downloaded = 0;
-    int last_percent = -1;
 
     char *buffer = (char *)heap_caps_malloc(config_.buffer_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     if (buffer == nullptr) {
@@ -89,7 +101,7 @@ esp_err_t OtaManager::PerformOta() {
     
     if (buffer == nullptr) {
         ESP_LOGE(TAG, "Loi: RAM khong du cho buffer %zu bytes!", config_.buffer_size);
-        esp_ota_abort(ota_handle);
+        DiscardWrite();
         esp_http_client_close(client);
         esp_http_client_cleanup(client);
         NotifyProgress(OtaState::Failed, 0, 0, 0, "Loi cap phat bo nho!");
@@ -107,7 +119,7 @@ esp_err_t OtaManager::PerformOta() {
         if (is_aborted) {
             ESP_LOGW(TAG, "Cap nhat OTA bi huy boi nguoi dung!");
             free(buffer);
-            esp_ota_abort(ota_handle);
+            DiscardWrite();
             esp_http_client_close(client);
             esp_http_client_cleanup(client);
             NotifyProgress(OtaState::Idle, 0, 0, 0, "Da huy cap nhat!");
@@ -119,7 +131,7 @@ esp_err_t OtaManager::PerformOta() {
         if (read_len < 0) {
             ESP_LOGE(TAG, "Loi doc du lieu HTTP!");
             free(buffer);
-            esp_ota_abort(ota_handle);
+            DiscardWrite();
             esp_http_client_close(client);
             esp_http_client_cleanup(client);
             NotifyProgress(OtaState::Failed, 0, downloaded, total_bytes, "Loi doc du lieu!");
@@ -133,19 +145,18 @@ esp_err_t OtaManager::PerformOta() {
             }
             ESP_LOGE(TAG, "Connection lost!");
             free(buffer);
-            esp_ota_abort(ota_handle);
+            DiscardWrite();
             esp_http_client_close(client);
             esp_http_client_cleanup(client);
             NotifyProgress(OtaState::Failed, 0, downloaded, total_bytes, "Ket noi bi ngat!");
             return ESP_FAIL;
         }
 
-        // Ghi dữ liệu vào phân vùng OTA
-        err = esp_ota_write(ota_handle, buffer, read_len);
+        // Ghi dữ liệu vào phân vùng OTA (Write tự báo tiến trình)
+        err = Write(buffer, read_len);
         if (err != ESP_OK) {
-            ESP_LOGE(TAG, "esp_ota_write that bai: %s", esp_err_to_name(err));
             free(buffer);
-            esp_ota_abort(ota_handle);
+            DiscardWrite();
             esp_http_client_close(client);
             esp_http_client_cleanup(client);
             NotifyProgress(OtaState::Failed, 0, downloaded, total_bytes, "Loi ghi firmware!");
@@ -153,21 +164,6 @@ esp_err_t OtaManager::PerformOta() {
         }
 
         downloaded += read_len;
-
-        // Cập nhật tiến trình (chỉ khi phần trăm thay đổi để tránh spam)
-        if (total_bytes > 0) {
-            int percent = (int)((downloaded * 100) / total_bytes);
-            if (percent != last_percent) {
-                last_percent = percent;
-                NotifyProgress(OtaState::Downloading, percent, downloaded, total_bytes, "Dang tai firmware...");
-            }
-        } else {
-            // Trường hợp server không trả Content-Length (Chunked Transfer), log update mỗi 50KB
-            if ((int)downloaded - last_percent >= 51200) {
-                last_percent = (int)downloaded;
-                NotifyProgress(OtaState::Downloading, 0, downloaded, 0, "Dang tai firmware...");
-            }
-        }
     }
 
     free(buffer);
@@ -177,30 +173,5 @@ esp_err_t OtaManager::PerformOta() {
     ESP_LOGI(TAG, "Total Downloaded: %zu bytes", downloaded);
 
     // === Xác minh và hoàn tất ===
-    NotifyProgress(OtaState::Verifying, 100, downloaded, total_bytes, "Dang xac minh firmware...");
-
-    err = esp_ota_end(ota_handle);
-    if (err != ESP_OK) {
-        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
-            ESP_LOGE(TAG, "Invalid Firmware (Checksum error)!");
-        } else {
-            ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
-        }
-        NotifyProgress(OtaState::Failed, 0, downloaded, total_bytes, "Firmware khong hop le!");
-        return err;
-    }
-
-    // Đặt phân vùng boot mới
-    err = esp_ota_set_boot_partition(update_partition);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
-        NotifyProgress(OtaState::Failed, 0, downloaded, total_bytes, "Loi dat phan vung boot!");
-        return err;
-    }
-
-    NotifyProgress(OtaState::Ready, 100, downloaded, total_bytes, 
-                   "Cap nhat thanh cong! Can khoi dong lai.");
-    ESP_LOGI(TAG, "Update Success! Target: %s", update_partition->label);
-
-    return ESP_OK;
+    return EndWrite();
 }
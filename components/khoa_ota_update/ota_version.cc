@@ -4,12 +4,13 @@
  */
 
 #include "ota_manager.h"
+#include "asset_bundle.h"
 
 static const char *TAG = "OTA";
 
 /// Gọi POST lên server, gửi thông tin thiết bị, nhận version + firmware URL
 esp_err_t OtaManager::FetchVersionInfo(VersionInfo& out_info) {
-    std::string url = config_.url;
+    UrlString url = config_.url;
     if (url.empty()) return ESP_ERR_INVALID_ARG;
 
     std::string mac = GetMacString();
@@ -32,21 +33,27 @@ esp_err_t OtaManager::FetchVersionInfo(VersionInfo& out_info) {
     uint32_t flash_size = 0;
     esp_flash_get_size(NULL, &flash_size);
 
-    // Tạo JSON body
-    cJSON* body = cJSON_CreateObject();
-    cJSON_AddStringToObject(body, "mac",     mac.c_str());
-    cJSON_AddStringToObject(body, "version", ver.c_str());
-    cJSON_AddStringToObject(body, "chip",    chip_name);
-    cJSON_AddNumberToObject(body, "cores",   chip.cores);
-    cJSON_AddNumberToObject(body, "flash_kb", (double)(flash_size / 1024));
-    cJSON_AddStringToObject(body, "app_name", esp_app_get_description()->project_name);
-    char* body_str = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-    if (!body_str) return ESP_FAIL;
+    // Phiên bản giao diện web trong storage (0 = chưa có bundle), server dựa vào đó trả bundle mới
+    AssetBundle::GetInstance().Load();
+    uint32_t assets_version = AssetBundle::GetInstance().GetVersion();
+
+    // Tạo JSON body (buffer cố định trên stack, không cấp phát heap)
+    char body_buf[256];
+    JsonWriter body(body_buf, sizeof(body_buf));
+    body.BeginObject()
+        .Key("mac").String(mac)
+        .Key("version").String(ver)
+        .Key("chip").String(chip_name)
+        .Key("cores").Int(chip.cores)
+        .Key("flash_kb").Int(flash_size / 1024)
+        .Key("app_name").String(esp_app_get_description()->project_name)
+        .Key("assets").Int(assets_version)
+        .EndObject();
+    if (!body.Finish()) return ESP_ERR_INVALID_SIZE;
 
     // HTTP client
     HttpResponseCtx ctx = {(char*)calloc(1, 2049), 0, 2048};
-    if (!ctx.buf) { free(body_str); return ESP_ERR_NO_MEM; }
+    if (!ctx.buf) return ESP_ERR_NO_MEM;
 
     esp_http_client_config_t cfg = {};
     cfg.url = url.c_str();
@@ -58,17 +65,16 @@ esp_err_t OtaManager::FetchVersionInfo(VersionInfo& out_info) {
     configure_ssl(cfg, config_.cert_pem);
 
     esp_http_client_handle_t client = esp_http_client_init(&cfg);
-    if (!client) { free(body_str); free(ctx.buf); return ESP_FAIL; }
+    if (!client) { free(ctx.buf); return ESP_FAIL; }
 
     // Header: dùng MAC làm Device-Id (bảo mật bằng MAC duy nhất)
     esp_http_client_set_header(client, "Content-Type", "application/json");
     esp_http_client_set_header(client, "Device-Id", mac.c_str());
-    esp_http_client_set_post_field(client, body_str, (int)strlen(body_str));
+    esp_http_client_set_post_field(client, body.View().data(), (int)body.View().size());
 
     esp_err_t err = esp_http_client_perform(client);
     int status = esp_http_client_get_status_code(client);
     esp_http_client_cleanup(client);
-    free(body_str);
 
     if (err != ESP_OK) { free(ctx.buf); return err; }
     if (status != 200 || ctx.len <= 0) {
@@ -77,29 +83,58 @@ esp_err_t OtaManager::FetchVersionInfo(VersionInfo& out_info) {
         return ESP_FAIL;
     }
 
-    ctx.buf[ctx.len] = '\0';
-
-    // Parse JSON: { firmware: { version, url, force } }
-    cJSON* root = cJSON_Parse(ctx.buf);
-    free(ctx.buf);
-    if (!root) return ESP_ERR_INVALID_RESPONSE;
-
-    cJSON* fw = cJSON_GetObjectItem(root, "firmware");
+    // Parse JSON: { firmware: { version, url, force }, assets: { version, url } }, đọc trực tiếp trên buffer
+    JsonReader json(std::string_view(ctx.buf, ctx.len));
+    std::string_view key;
     bool ok = false;
-    if (cJSON_IsObject(fw)) {
-        cJSON* v = cJSON_GetObjectItem(fw, "version");
-        if (v && cJSON_IsString(v)) { out_info.version = v->valuestring; ok = true; }
-
-        cJSON* u = cJSON_GetObjectItem(fw, "url");
-        if (u && cJSON_IsString(u)) out_info.firmware_url = u->valuestring;
-
-        cJSON* f = cJSON_GetObjectItem(fw, "force");
-        if (f && cJSON_IsNumber(f)) out_info.force = (f->valueint == 1);
+    if (json.EnterObject()) {
+        while (json.NextKey(key)) {
+            if (key == "assets") {
+                if (!json.EnterObject()) continue;
+                while (json.NextKey(key)) {
+                    if (key == "version") {
+                        json.ReadInt(out_info.assets_version);
+                    } else if (key == "url") {
+                        bool truncated = false;
+                        if (json.ReadString(out_info.assets_url, &truncated) && truncated) {
+                            ESP_LOGW(TAG, "Assets URL quá dài, bị cắt");
+                            out_info.assets_url = UrlString();
+                        }
+                    } else {
+                        json.SkipValue();
+                    }
+                }
+                continue;
+            }
+            if (key != "firmware") {
+                json.SkipValue();
+                continue;
+            }
+            if (!json.EnterObject()) continue;   // Không phải object: đã bị bỏ qua
+            while (json.NextKey(key)) {
+                if (key == "version") {
+                    ok = json.ReadString(out_info.version);
+                } else if (key == "url") {
+                    bool truncated = false;
+                    if (json.ReadString(out_info.firmware_url, &truncated) && truncated) {
+                        ESP_LOGW(TAG, "Firmware URL quá dài, bị cắt");
+                    }
+                } else if (key == "force") {
+                    int force = 0;
+                    if (json.ReadInt(force)) out_info.force = (force == 1);
+                } else {
+                    json.SkipValue();
+                }
+            }
+        }
     }
-    cJSON_Delete(root);
+    free(ctx.buf);
+    if (!json.ok()) return ESP_ERR_INVALID_RESPONSE;
+    if (!ok) ESP_LOGW(TAG, "Response thiếu firmware.version");
 
-    ESP_LOGI(TAG, "Server Version: %s (Force: %s)",
+    ESP_LOGI(TAG, "Server Version: %s (Force: %s) | Assets: v%" PRIu32 " (dang co v%" PRIu32 ")",
              out_info.version.c_str(),
-             out_info.force ? "YES" : "NO");
+             out_info.force ? "YES" : "NO",
+             out_info.assets_version, assets_version);
     return ESP_OK;
 }
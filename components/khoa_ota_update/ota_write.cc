@@ -0,0 +1,186 @@
+/*
+ * OTA Write - Đường ghi firmware dùng chung
+ * PerformOta (tải từ server) và nguồn ngoài (upload qua trang cấu hình) cùng ghi qua đây:
+ * mở phân vùng → ghi từng phần + báo tiến trình → xác minh + đặt boot
+ */
+
+#include "ota_manager.h"
+#include <algorithm>
+
+static const char *TAG = "OTA";
+
+// ==================== Nguồn ngoài ====================
+
+/// Nhận firmware do nơi khác đẩy vào, total_bytes = 0 nếu chưa biết kích thước
+esp_err_t OtaManager::BeginWrite(size_t total_bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ != OtaState::Idle && state_ != OtaState::Failed) return ESP_ERR_INVALID_STATE;
+        abort_requested_ = false;
+        state_ = OtaState::Downloading;
+    }
+
+    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    if (update_partition == nullptr) {
+        ESP_LOGE(TAG, "Khong tim thay phan vung OTA tiep theo!");
+        NotifyProgress(OtaState::Failed, 0, 0, total_bytes, "Khong tim thay phan vung cap nhat!");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    NotifyTransfer(true);
+    esp_err_t err = OpenWrite(update_partition, total_bytes, true);
+    if (err != ESP_OK) {
+        NotifyTransfer(false);
+        NotifyProgress(OtaState::Failed, 0, 0, total_bytes, "Khong the bat dau ghi OTA!");
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Upload -> Partition: %s (%zu bytes)", update_partition->label, total_bytes);
+    NotifyProgress(OtaState::Downloading, 0, 0, total_bytes, "Dang nhan firmware...");
+    return ESP_OK;
+}
+
+/// Hủy phiên ghi đang mở (nguồn ngắt giữa chừng, image sai...)
+void OtaManager::AbortWrite() {
+    if (write_partition_ == nullptr) return;
+    bool external = write_external_;
+    size_t done = write_done_;
+    size_t total = write_total_;
+    DiscardWrite();
+    if (external) NotifyTransfer(false);
+    NotifyProgress(OtaState::Failed, 0, done, total, "Da huy ghi firmware!");
+}
+
+// ==================== Đường ghi chung ====================
+
+esp_err_t OtaManager::OpenWrite(const esp_partition_t* partition, size_t total_bytes, bool external) {
+    if (total_bytes > partition->size) {
+        ESP_LOGE(TAG, "Firmware %zu bytes lon hon phan vung %s (%" PRIu32 " bytes)",
+                 total_bytes, partition->label, partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &write_handle_);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin that bai: %s", esp_err_to_name(err));
+        write_handle_ = 0;
+        return err;
+    }
+
+    write_partition_ = partition;
+    write_total_ = total_bytes;
+    write_done_ = 0;
+    write_notified_ = (total_bytes > 0) ? SIZE_MAX : 0;
+    write_external_ = external;
+    return ESP_OK;
+}
+
+void OtaManager::DiscardWrite() {
+    if (write_partition_ == nullptr) return;
+    esp_ota_abort(write_handle_);
+    write_handle_ = 0;
+    write_partition_ = nullptr;
+}
+
+/// Ghi một phần firmware vào phân vùng OTA, báo tiến trình khi % thay đổi
+esp_err_t OtaManager::Write(const void* data, size_t length) {
+    if (write_partition_ == nullptr) return ESP_ERR_INVALID_STATE;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (abort_requested_) return ESP_ERR_INVALID_STATE;
+    }
+
+    // Gom header image, kiểm tra ngay khi đủ (trước khi ghi tiếp phần còn lại)
+    if (write_external_ && write_done_ < kImageHeaderSize) {
+        size_t n = std::min(length, kImageHeaderSize - write_done_);
+        memcpy(image_header_ + write_done_, data, n);
+        if (write_done_ + n == kImageHeaderSize) {
+            esp_err_t err = CheckImageHeader();
+            if (err != ESP_OK) return err;
+        }
+    }
+
+    esp_err_t err = esp_ota_write(write_handle_, data, length);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_write that bai: %s", esp_err_to_name(err));
+        return err;
+    }
+    write_done_ += length;
+
+    const char* message = write_external_ ? "Dang nhan firmware..." : "Dang tai firmware...";
+    if (write_total_ > 0) {
+        size_t percent = (write_done_ * 100) / write_total_;
+        if (percent != write_notified_) {
+            write_notified_ = percent;
+            NotifyProgress(OtaState::Downloading, (int)percent, write_done_, write_total_, message);
+        }
+    } else if (write_done_ - write_notified_ >= 51200) {
+        // Không biết tổng dung lượng (Chunked Transfer): báo mỗi 50KB
+        write_notified_ = write_done_;
+        NotifyProgress(OtaState::Downloading, 0, write_done_, 0, message);
+    }
+    return ESP_OK;
+}
+
+/// Xác minh image đã ghi và đặt làm phân vùng boot
+esp_err_t OtaManager::EndWrite() {
+    if (write_partition_ == nullptr) return ESP_ERR_INVALID_STATE;
+    const esp_partition_t *partition = write_partition_;
+    esp_ota_handle_t handle = write_handle_;
+    size_t done = write_done_;
+    size_t total = write_total_;
+    bool external = write_external_;
+    write_partition_ = nullptr;
+    write_handle_ = 0;
+
+    NotifyProgress(OtaState::Verifying, 100, done, total, "Dang xac minh firmware...");
+
+    // esp_ota_end giải phóng handle kể cả khi xác minh thất bại
+    esp_err_t err = esp_ota_end(handle);
+    if (err != ESP_OK) {
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            ESP_LOGE(TAG, "Invalid Firmware (Checksum error)!");
+        } else {
+            ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
+        }
+        NotifyProgress(OtaState::Failed, 0, done, total, "Firmware khong hop le!");
+    } else if ((err = esp_ota_set_boot_partition(partition)) != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        NotifyProgress(OtaState::Failed, 0, done, total, "Loi dat phan vung boot!");
+    } else {
+        NotifyProgress(OtaState::Ready, 100, done, total,
+                       "Cap nhat thanh cong! Can khoi dong lai.");
+        ESP_LOGI(TAG, "Update Success! Target: %s", partition->label);
+    }
+
+    if (external) NotifyTransfer(false);
+    return err;
+}
+
+/// esp_app_desc_t nằm ngay sau header image và header segment đầu tiên
+esp_err_t OtaManager::CheckImageHeader() const {
+    esp_app_desc_t desc;
+    memcpy(&desc, image_header_ + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(desc));
+    if (desc.magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        ESP_LOGE(TAG, "Image khong co app descriptor!");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    const esp_app_desc_t* running = esp_app_get_description();
+    if (strncmp(desc.project_name, running->project_name, sizeof(desc.project_name)) != 0) {
+        ESP_LOGE(TAG, "Firmware cua project khac: %.*s (dang chay %s)",
+                 (int)sizeof(desc.project_name), desc.project_name, running->project_name);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    ESP_LOGI(TAG, "Upload Version: %.*s", (int)sizeof(desc.version), desc.version);
+    return ESP_OK;
+}
+
+void OtaManager::NotifyTransfer(bool active) {
+    std::function<void(bool)> cb;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cb = transfer_callback_;
+    }
+    if (cb) cb(active);
+}
@@ -0,0 +1,215 @@
+#include "ap_history.h"
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs_flash.h>
+
+#define TAG "ApHistory"
+#define NVS_NAMESPACE "wifi"
+#define NVS_KEY "ap_hist"
+#define AP_HISTORY_VERSION 1
+
+// Score tuning (dB-equivalent)
+#define FAILURE_PENALTY_MAX      30   // Applied at 0% success rate
+#define DISCONNECT_PENALTY_STEP  10   // Per disconnect per successful session
+#define DISCONNECT_PENALTY_MAX   20
+#define SLOW_CONNECT_THRESHOLD   3000 // ms, assoc + dhcp
+#define SLOW_CONNECT_PENALTY_MAX 10
+#define PROVEN_BONUS             3    // Reliable AP with enough samples
+
+ApHistory::ApHistory() {
+    LoadFromNvs();
+}
+
+void ApHistory::LoadFromNvs() {
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+
+    size_t length = sizeof(table_);
+    esp_err_t err = nvs_get_blob(nvs, NVS_KEY, &table_, &length);
+    nvs_close(nvs);
+    if (err != ESP_OK) {
+        table_.count = 0;
+        return;
+    }
+
+    if (table_.version != AP_HISTORY_VERSION || table_.count > kMaxEntries ||
+        length != offsetof(Table, entries) + table_.count * sizeof(Entry)) {
+        ESP_LOGW(TAG, "Discarding incompatible history blob");
+        table_.count = 0;
+        return;
+    }
+
+    for (int i = 0; i < table_.count; i++) {
+        sequence_ = std::max(sequence_, table_.entries[i].last_used);
+    }
+    ESP_LOGI(TAG, "Loaded %d history entries", table_.count);
+}
+
+void ApHistory::Save() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (!new_entry_ && last_save_us_ != 0 && now - last_save_us_ < kSaveIntervalMs * 1000) {
+        return;
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS");
+        return;
+    }
+    table_.version = AP_HISTORY_VERSION;
+    esp_err_t err = nvs_set_blob(nvs, NVS_KEY, &table_,
+                                 offsetof(Table, entries) + table_.count * sizeof(Entry));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save history: %s", esp_err_to_name(err));
+        return;
+    }
+    dirty_ = false;
+    new_entry_ = false;
+    last_save_us_ = now;
+}
+
+void ApHistory::Clear() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        table_.count = 0;
+        sequence_ = 0;
+        dirty_ = true;
+        new_entry_ = true;
+    }
+    Save();
+}
+
+ApHistory::Entry* ApHistory::Find(std::string_view ssid, const uint8_t bssid[6]) {
+    for (int i = 0; i < table_.count; i++) {
+        if (memcmp(table_.entries[i].bssid, bssid, 6) == 0 && ssid == table_.entries[i].ssid) {
+            return &table_.entries[i];
+        }
+    }
+    return nullptr;
+}
+
+ApHistory::Entry* ApHistory::FindOrCreate(std::string_view ssid, const uint8_t bssid[6]) {
+    Entry* entry = Find(ssid, bssid);
+    if (entry != nullptr) {
+        return entry;
+    }
+
+    if (table_.count < kMaxEntries) {
+        entry = &table_.entries[table_.count++];
+    } else {
+        // Evict the least recently used entry
+        entry = std::min_element(table_.entries, table_.entries + kMaxEntries, [](const Entry& a, const Entry& b) {
+            return a.last_used < b.last_used;
+        });
+    }
+    new_entry_ = true;
+    memset(entry, 0, sizeof(Entry));
+    size_t length = std::min(ssid.size(), sizeof(entry->ssid) - 1);
+    memcpy(entry->ssid, ssid.data(), length);
+    entry->ssid[length] = '\0';
+    memcpy(entry->bssid, bssid, 6);
+    return entry;
+}
+
+void ApHistory::Touch(Entry* entry) {
+    entry->last_used = ++sequence_;
+    dirty_ = true;
+}
+
+void ApHistory::Decay(Entry* entry) {
+    if (entry->attempts >= kCounterLimit) {
+        entry->attempts /= 2;
+        entry->successes /= 2;
+        entry->disconnects /= 2;
+    }
+}
+
+void ApHistory::RecordSuccess(std::string_view ssid, const uint8_t bssid[6], int assoc_ms, int dhcp_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = FindOrCreate(ssid, bssid);
+    assoc_ms = std::clamp(assoc_ms, 0, 0xFFFF);
+    dhcp_ms = std::clamp(dhcp_ms, 0, 0xFFFF);
+    if (entry->successes == 0) {
+        entry->assoc_ms = assoc_ms;
+        entry->dhcp_ms = dhcp_ms;
+    } else {
+        // Moving average with 1/4 weight for the new sample
+        entry->assoc_ms = (entry->assoc_ms * 3 + assoc_ms) / 4;
+        entry->dhcp_ms = (entry->dhcp_ms * 3 + dhcp_ms) / 4;
+    }
+    entry->attempts++;
+    entry->successes++;
+    Decay(entry);
+    Touch(entry);
+}
+
+void ApHistory::RecordFailure(std::string_view ssid, const uint8_t bssid[6]) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = FindOrCreate(ssid, bssid);
+    entry->attempts++;
+    Decay(entry);
+    Touch(entry);
+}
+
+void ApHistory::RecordDisconnect(std::string_view ssid, const uint8_t bssid[6]) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = FindOrCreate(ssid, bssid);
+    if (entry->disconnects < kCounterLimit) {
+        entry->disconnects++;
+    }
+    Touch(entry);
+}
+
+int ApHistory::Penalty(int attempts, int successes, int disconnects, int connect_ms) {
+    if (attempts == 0) {
+        return 0;  // Unknown network, rank by RSSI only
+    }
+
+    int penalty = FAILURE_PENALTY_MAX * (attempts - successes) / attempts;
+    if (successes > 0) {
+        penalty += std::min(DISCONNECT_PENALTY_STEP * disconnects / successes, DISCONNECT_PENALTY_MAX);
+        if (connect_ms > SLOW_CONNECT_THRESHOLD) {
+            penalty += std::min((connect_ms - SLOW_CONNECT_THRESHOLD) / 1000, SLOW_CONNECT_PENALTY_MAX);
+        }
+    }
+    if (attempts >= 3 && successes == attempts && disconnects == 0) {
+        penalty -= PROVEN_BONUS;
+    }
+    return penalty;
+}
+
+int ApHistory::Score(std::string_view ssid, const uint8_t bssid[6], int rssi) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Entry* entry = Find(ssid, bssid);
+    if (entry != nullptr) {
+        return rssi - Penalty(entry->attempts, entry->successes, entry->disconnects,
+                              entry->assoc_ms + entry->dhcp_ms);
+    }
+
+    // Unseen BSSID: fall back to the aggregate history of its SSID
+    int attempts = 0, successes = 0, disconnects = 0, connect_ms = 0;
+    for (int i = 0; i < table_.count; i++) {
+        const Entry& item = table_.entries[i];
+        if (ssid == item.ssid) {
+            attempts += item.attempts;
+            successes += item.successes;
+            disconnects += item.disconnects;
+            connect_ms = std::max(connect_ms, item.assoc_ms + item.dhcp_ms);
+        }
+    }
+    return rssi - Penalty(attempts, successes, disconnects, connect_ms);
+}
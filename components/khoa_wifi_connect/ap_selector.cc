@@ -0,0 +1,84 @@
+#include "ap_selector.h"
+#include "ap_history.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+// Weight of an interfering AP by received strength, in half units
+static int InterfererWeight(int rssi) {
+    if (rssi >= -60) return 6;
+    if (rssi >= -75) return 4;
+    return 2;
+}
+
+int ApSelector::ChannelLoad(uint8_t channel, const wifi_ap_record_t* records, int count, const uint8_t* exclude) {
+    int occupancy = 0;  // Half units
+    for (int i = 0; i < count; i++) {
+        const auto& other = records[i];
+        if (exclude != nullptr && memcmp(other.bssid, exclude, 6) == 0) {
+            continue;
+        }
+        if (Is5GHz(other.primary) != Is5GHz(channel)) {
+            continue;
+        }
+        int distance = abs((int)other.primary - (int)channel);
+        if (distance == 0) {
+            occupancy += InterfererWeight(other.rssi);
+        } else if (!Is5GHz(channel) && distance <= 4) {
+            // 20 MHz channels 5 MHz apart partially overlap on 2.4 GHz
+            occupancy += InterfererWeight(other.rssi) / 2;
+        }
+    }
+    return occupancy;
+}
+
+ApChannelChoice ApSelector::QuietestChannel(const wifi_ap_record_t* records, int count, uint8_t first, uint8_t last) {
+    ApChannelChoice best;
+    auto consider = [&](uint8_t channel) {
+        if (channel < first || channel > last) {
+            return;
+        }
+        int load = ChannelLoad(channel, records, count);
+        if (best.channel == 0 || load < best.load) {
+            best.channel = channel;
+            best.load = load;
+        }
+    };
+    for (uint8_t channel : {1, 6, 11}) {
+        consider(channel);
+    }
+    for (uint8_t channel = first; channel <= last; channel++) {
+        consider(channel);
+    }
+    return best;
+}
+
+int ApSelector::CongestionPenalty(const wifi_ap_record_t& ap, const wifi_ap_record_t* records, int count) const {
+    int occupancy = ChannelLoad(ap.primary, records, count, ap.bssid);
+    return std::min(policy_.congestion_penalty_db * occupancy / 4, policy_.congestion_penalty_max_db);
+}
+
+int ApSelector::Score(const wifi_ap_record_t& ap, const wifi_ap_record_t* records, int count) const {
+    int score = ApHistory::GetInstance().Score((const char*)ap.ssid, ap.bssid, ap.rssi);
+    if (Is5GHz(ap.primary)) {
+        score += policy_.band_5g_preference_db;
+    }
+    return score - CongestionPenalty(ap, records, count);
+}
+
+const wifi_ap_record_t* ApSelector::SelectBest(const char* ssid, const wifi_ap_record_t* records, int count) const {
+    const wifi_ap_record_t* best = nullptr;
+    int best_score = 0;
+    for (int i = 0; i < count; i++) {
+        if (strcmp((const char*)records[i].ssid, ssid) != 0) {
+            continue;
+        }
+        int score = Score(records[i], records, count);
+        if (best == nullptr || score > best_score) {
+            best = &records[i];
+            best_score = score;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,87 @@
+#include "dns_responder.h"
+#include <cstring>
+
+// DNS wire format (RFC 1035)
+#define DNS_HEADER_SIZE  12
+#define DNS_MAX_NAME     255
+#define DNS_MAX_LABEL    63
+#define DNS_TYPE_A       1
+#define DNS_TYPE_ANY     255
+#define DNS_CLASS_IN     1
+#define DNS_FLAG_QR      0x80  // Flags byte 1
+#define DNS_OPCODE_MASK  0x78
+#define DNS_FLAG_AA      0x04
+#define DNS_FLAG_RD      0x01
+#define DNS_FLAG_RA      0x80  // Flags byte 2, RCODE 0 (NOERROR) in the low bits
+
+void DnsResponder::SetGateway(uint32_t gateway) {
+    // Answer record: name pointer to the question, type A, class IN, TTL, address
+    const uint8_t header[] = {
+        0xc0, 0x0c,
+        0x00, DNS_TYPE_A,
+        0x00, DNS_CLASS_IN,
+        (uint8_t)(kAnswerTtl >> 24), (uint8_t)(kAnswerTtl >> 16), (uint8_t)(kAnswerTtl >> 8), (uint8_t)kAnswerTtl,
+        0x00, 0x04
+    };
+    static_assert(sizeof(header) + 4 == sizeof(answer_a_));
+    memcpy(answer_a_, header, sizeof(header));
+    memcpy(&answer_a_[sizeof(header)], &gateway, 4);
+}
+
+int DnsResponder::BuildResponse(const uint8_t* query, int len, uint8_t* response, int size) const {
+    if (len < DNS_HEADER_SIZE) {
+        return -1;
+    }
+    // Standard queries only: QR clear, opcode QUERY, exactly one question
+    if ((query[2] & (DNS_FLAG_QR | DNS_OPCODE_MASK)) != 0 || query[4] != 0 || query[5] != 1) {
+        return -1;
+    }
+
+    // Question name; compression pointers (>= 0xc0) are not valid here
+    int pos = DNS_HEADER_SIZE;
+    int name_len = 0;
+    while (true) {
+        if (pos >= len) {
+            return -1;
+        }
+        uint8_t label = query[pos];
+        if (label == 0) {
+            pos++;
+            break;
+        }
+        if (label > DNS_MAX_LABEL) {
+            return -1;
+        }
+        name_len += label + 1;
+        if (name_len > DNS_MAX_NAME) {
+            return -1;
+        }
+        pos += label + 1;
+    }
+    if (pos + 4 > len) {
+        return -1;
+    }
+    uint16_t qtype = (query[pos] << 8) | query[pos + 1];
+    uint16_t qclass = (query[pos + 2] << 8) | query[pos + 3];
+    pos += 4;
+
+    // Only A gets the gateway; AAAA, HTTPS and the rest get NOERROR with no
+    // answer so the client does not wait for a timeout
+    bool answer = (qtype == DNS_TYPE_A || qtype == DNS_TYPE_ANY) && qclass == DNS_CLASS_IN;
+    int response_len = pos + (answer ? (int)sizeof(answer_a_) : 0);
+    if (response_len > size) {
+        return -1;
+    }
+
+    // Header and question are echoed; additional records (EDNS OPT) are not
+    memcpy(response, query, pos);
+    response[2] = DNS_FLAG_QR | DNS_FLAG_AA | (query[2] & DNS_FLAG_RD);
+    response[3] = DNS_FLAG_RA;
+    response[6] = 0;
+    response[7] = answer ? 1 : 0;     // ANCOUNT
+    memset(&response[8], 0, 4);       // NSCOUNT, ARCOUNT
+    if (answer) {
+        memcpy(&response[pos], answer_a_, sizeof(answer_a_));
+    }
+    return response_len;
+}
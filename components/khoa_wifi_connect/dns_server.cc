@@ -1,4 +1,7 @@
 #include "dns_server.h"
+#include <cstring>
+#include <cinttypes>
+#include <algorithm>
 #include <esp_log.h>
 #include <lwip/sockets.h>
 #include <lwip/netdb.h>
@@ -20,6 +23,9 @@ void DnsServer::Start(esp_ip4_addr_t gateway) {
 
     ESP_LOGI(TAG, "Starting DNS server");
     gateway_ = gateway;
+    responder_.SetGateway(gateway_.addr);
+    memset(clients_, 0, sizeof(clients_));
+    queries_ = answered_a_ = answered_empty_ = malformed_ = rate_limited_ = send_errors_ = 0;
 
     fd_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (fd_ < 0) {
@@ -41,11 +47,23 @@ void DnsServer::Start(esp_ip4_addr_t gateway) {
     }
 
     running_ = true;
-    xTaskCreate([](void* arg) {
+    stop_waiter_ = nullptr;
+    BaseType_t created = xTaskCreate([](void* arg) {
         DnsServer* dns_server = static_cast<DnsServer*>(arg);
         dns_server->Run();
+        // Last access to dns_server: Stop() may destroy it once notified
+        TaskHandle_t waiter = dns_server->stop_waiter_.exchange(nullptr);
+        if (waiter != nullptr) {
+            xTaskNotifyGive(waiter);
+        }
         vTaskDelete(NULL);
     }, "DnsServerTask", 4096, this, 5, &task_handle_);
+    if (created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create DNS server task");
+        running_ = false;
+        close(fd_);
+        fd_ = -1;
+    }
 }
 
 void DnsServer::Stop() {
@@ -54,6 +72,7 @@ void DnsServer::Stop() {
     }
 
     ESP_LOGI(TAG, "Stopping DNS server");
+    stop_waiter_ = xTaskGetCurrentTaskHandle();
     running_ = false;
 
     // Close socket to unblock recvfrom
@@ -63,20 +82,30 @@ void DnsServer::Stop() {
         fd_ = -1;
     }
 
-    // Wait for task to finish
-    if (task_handle_ != nullptr) {
-        // Give the task some time to exit gracefully
-        vTaskDelay(pdMS_TO_TICKS(100));
-        task_handle_ = nullptr;
-    }
+    // Join the task: it notifies us right before deleting itself. No timeout,
+    // the caller frees this object next and Run() must be done with it; the
+    // closed socket ends recvfrom(), so the wait is short.
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    task_handle_ = nullptr;
+
+    Stats stats = GetStats();
+    ESP_LOGI(TAG, "DNS server stopped: %" PRIu32 " queries, %" PRIu32 " A, %" PRIu32 " empty, "
+             "%" PRIu32 " malformed, %" PRIu32 " rate-limited, %" PRIu32 " send errors",
+             stats.queries, stats.answered_a, stats.answered_empty,
+             stats.malformed, stats.rate_limited, stats.send_errors);
+}
+
+DnsServer::Stats DnsServer::GetStats() const {
+    return Stats{queries_, answered_a_, answered_empty_, malformed_, rate_limited_, send_errors_};
 }
 
 void DnsServer::Run() {
-    char buffer[512];
+    uint8_t query[512];      // Longer (EDNS) datagrams are truncated; only the question is needed
+    uint8_t response[512];
     while (running_) {
         struct sockaddr_in client_addr;
         socklen_t client_addr_len = sizeof(client_addr);
-        int len = recvfrom(fd_, buffer, sizeof(buffer), 0, (struct sockaddr *)&client_addr, &client_addr_len);
+        int len = recvfrom(fd_, query, sizeof(query), 0, (struct sockaddr *)&client_addr, &client_addr_len);
         if (len < 0) {
             if (!running_) {
                 // Socket was closed during Stop(), exit gracefully
@@ -90,23 +119,65 @@ void DnsServer::Run() {
             break;
         }
 
-        // Simple DNS response: point all queries to 192.168.4.1
-        buffer[2] |= 0x80;  // Set response flag
-        buffer[3] |= 0x80;  // Set Recursion Available
-        buffer[7] = 1;      // Set answer count to 1
-
-        // Add answer section
-        memcpy(&buffer[len], "\xc0\x0c", 2);  // Name pointer
-        len += 2;
-        memcpy(&buffer[len], "\x00\x01\x00\x01\x00\x00\x00\x1c\x00\x04", 10);  // Type, class, TTL, data length
-        len += 10;
-        memcpy(&buffer[len], &gateway_.addr, 4);  // 192.168.4.1
-        len += 4;
-        ESP_LOGI(TAG, "Sending DNS response to %s", inet_ntoa(gateway_.addr));
-
-        sendto(fd_, buffer, len, 0, (struct sockaddr *)&client_addr, client_addr_len);
+        queries_++;
+        if (!Admit(client_addr.sin_addr.s_addr)) {
+            rate_limited_++;
+            continue;
+        }
+        int response_len = responder_.BuildResponse(query, len, response, sizeof(response));
+        if (response_len < 0) {
+            malformed_++;
+            continue;
+        }
+        if (response[7] != 0) {
+            answered_a_++;
+        } else {
+            answered_empty_++;
+        }
+
+        if (sendto(fd_, response, response_len, 0, (struct sockaddr *)&client_addr, client_addr_len) < 0) {
+            send_errors_++;
+        }
     }
 
     task_handle_ = nullptr;
     ESP_LOGI(TAG, "DNS server task exiting");
 }
+
+// Token bucket per client address; the least recently seen slot goes to a new client
+bool DnsServer::Admit(uint32_t addr) {
+    TickType_t now = xTaskGetTickCount();
+    Client* client = nullptr;
+    Client* oldest = &clients_[0];
+    for (auto& slot : clients_) {
+        if (slot.addr == addr) {
+            client = &slot;
+            break;
+        }
+        if (now - slot.last_refill > now - oldest->last_refill) {
+            oldest = &slot;
+        }
+    }
+    if (client == nullptr) {
+        client = oldest;
+        client->addr = addr;
+        client->tokens = kBurstQueries;
+        client->last_refill = now;
+    } else {
+        const TickType_t ticks_per_token = std::max<TickType_t>(1, configTICK_RATE_HZ / kQueriesPerSecond);
+        TickType_t elapsed = now - client->last_refill;
+        if (elapsed >= ticks_per_token * kBurstQueries) {
+            client->tokens = kBurstQueries;
+            client->last_refill = now;
+        } else if (elapsed >= ticks_per_token) {
+            int32_t refill = elapsed / ticks_per_token;
+            client->tokens = std::min<int32_t>(kBurstQueries, client->tokens + refill);
+            client->last_refill += refill * ticks_per_token;
+        }
+    }
+    if (client->tokens <= 0) {
+        return false;
+    }
+    client->tokens--;
+    return true;
+}
@@ -0,0 +1,78 @@
+#include "httpd_worker_pool.h"
+
+#include <esp_log.h>
+#include <freertos/task.h>
+
+#define TAG "HttpdWorkerPool"
+
+HttpdWorkerPool::~HttpdWorkerPool() {
+    Stop();
+}
+
+bool HttpdWorkerPool::Start(int workers, int queue_length, int stack_size, int priority) {
+    if (queue_ != nullptr) {
+        return true;
+    }
+    queue_ = xQueueCreate(queue_length, sizeof(Job));
+    exited_ = xSemaphoreCreateCounting(workers, 0);
+    if (queue_ == nullptr || exited_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create the job queue");
+        Stop();
+        return false;
+    }
+    for (int i = 0; i < workers; i++) {
+        if (xTaskCreate(&HttpdWorkerPool::WorkerTask, "httpd_worker", stack_size, this, priority, nullptr) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create worker %d", i);
+            break;
+        }
+        workers_++;
+    }
+    return workers_ > 0;
+}
+
+void HttpdWorkerPool::Stop() {
+    if (queue_ != nullptr) {
+        // Exit markers queue up behind the pending jobs, which still get served
+        Job stop = {nullptr, nullptr};
+        for (int i = 0; i < workers_; i++) {
+            xQueueSend(queue_, &stop, portMAX_DELAY);
+        }
+        for (int i = 0; i < workers_; i++) {
+            xSemaphoreTake(exited_, portMAX_DELAY);
+        }
+        vQueueDelete(queue_);
+        queue_ = nullptr;
+    }
+    if (exited_ != nullptr) {
+        vSemaphoreDelete(exited_);
+        exited_ = nullptr;
+    }
+    workers_ = 0;
+}
+
+esp_err_t HttpdWorkerPool::Submit(httpd_req_t* req, Handler handler, void* user_ctx) {
+    httpd_req_t* copy = nullptr;
+    if (queue_ != nullptr && httpd_req_async_handler_begin(req, &copy) == ESP_OK) {
+        copy->user_ctx = user_ctx;
+        Job job = {copy, handler};
+        if (xQueueSend(queue_, &job, 0) == pdTRUE) {
+            return ESP_OK;
+        }
+        httpd_req_async_handler_complete(copy);
+        ESP_LOGW(TAG, "All workers busy, handling %s inline", req->uri);
+    }
+    req->user_ctx = user_ctx;
+    return handler(req);
+}
+
+void HttpdWorkerPool::WorkerTask(void* arg) {
+    auto* this_ = static_cast<HttpdWorkerPool*>(arg);
+    Job job;
+    while (xQueueReceive(this_->queue_, &job, portMAX_DELAY) == pdTRUE && job.req != nullptr) {
+        job.handler(job.req);
+        httpd_req_async_handler_complete(job.req);
+    }
+    // Last access to this_: Stop() may delete the queue once all workers gave
+    xSemaphoreGive(this_->exited_);
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,80 @@
+#ifndef AP_HISTORY_H
+#define AP_HISTORY_H
+
+#include <cstdint>
+#include <string_view>
+#include <mutex>
+
+/**
+ * ApHistory - Persisted per-network connection history
+ *
+ * Keeps a small LRU table of BSSIDs the station has tried, with success rate,
+ * time to associate, time to get an IP and disconnect frequency. The table is
+ * stored as one blob in NVS ("wifi" / "ap_hist") and is used to rank scan
+ * candidates so that a flaky AP does not win just because its RSSI is high.
+ *
+ * Per-SSID history is derived by aggregating all BSSIDs of that SSID, which is
+ * used as the prior for a BSSID that has never been seen before.
+ */
+class ApHistory {
+public:
+    static ApHistory& GetInstance() {
+        static ApHistory instance;
+        return instance;
+    }
+
+    void RecordSuccess(std::string_view ssid, const uint8_t bssid[6], int assoc_ms, int dhcp_ms);
+    void RecordFailure(std::string_view ssid, const uint8_t bssid[6]);
+    void RecordDisconnect(std::string_view ssid, const uint8_t bssid[6]);
+
+    // Ranking score in dB-equivalent units, higher is better
+    int Score(std::string_view ssid, const uint8_t bssid[6], int rssi);
+
+    // Write the table to NVS if it changed since the last save. A new BSSID and the
+    // first save after boot are written at once; counter updates of known BSSIDs at
+    // most every kSaveIntervalMs, so a link that keeps reconnecting doesn't wear flash.
+    void Save();
+    void Clear();
+
+private:
+    static constexpr int kMaxEntries = 16;
+    static constexpr uint8_t kCounterLimit = 200;  // Halve counters beyond this to favour recent behaviour
+    static constexpr int64_t kSaveIntervalMs = 10 * 60 * 1000;
+
+    struct Entry {
+        char ssid[33];
+        uint8_t bssid[6];
+        uint8_t attempts;
+        uint8_t successes;
+        uint8_t disconnects;
+        uint16_t assoc_ms;   // Moving average
+        uint16_t dhcp_ms;    // Moving average
+        uint32_t last_used;  // Use sequence, for LRU eviction
+    };
+
+    // Stored as-is in NVS, truncated after the last used entry
+    struct Table {
+        uint8_t version;
+        uint8_t count;
+        Entry entries[kMaxEntries];
+    };
+
+    ApHistory();
+    ~ApHistory() = default;
+
+    Entry* Find(std::string_view ssid, const uint8_t bssid[6]);
+    Entry* FindOrCreate(std::string_view ssid, const uint8_t bssid[6]);
+    void Touch(Entry* entry);
+    static void Decay(Entry* entry);
+    static int Penalty(int attempts, int successes, int disconnects, int connect_ms);
+    void LoadFromNvs();
+
+    std::mutex mutex_;
+    Table table_ = {};
+    uint32_t sequence_ = 0;
+    bool dirty_ = false;
+    bool new_entry_ = false;     // An entry was added or evicted since the last save
+    int64_t last_save_us_ = 0;   // esp_timer time of the last write, 0 before the first
+};
+
+#endif // AP_HISTORY_H
@@ -0,0 +1,62 @@
+#ifndef AP_SELECTOR_H
+#define AP_SELECTOR_H
+
+#include <esp_wifi_types_generic.h>
+
+// Tuning for choosing between BSSIDs, all values in dB-equivalent
+struct ApSelectionPolicy {
+    int band_5g_preference_db = 10;      // Bonus for 5 GHz BSSIDs on dual-band chips
+    int congestion_penalty_db = 2;       // Per co-channel AP, weighted by how loud it is
+    int congestion_penalty_max_db = 15;
+};
+
+// Channel the config AP settled on
+struct ApChannelChoice {
+    uint8_t channel = 0;      // 0 before the AP started
+    int load = -1;            // ApSelector::ChannelLoad() of the channel, -1 when not surveyed
+    bool shared = false;      // Imposed by the associated station
+};
+
+/**
+ * ApSelector - Band and congestion aware BSSID ranking
+ *
+ * Score = RSSI adjusted by connection history (ApHistory)
+ *       + 5 GHz preference
+ *       - channel congestion
+ *
+ * wifi_ap_record_t carries no BSS Load (channel utilization) element, so
+ * congestion is estimated from the other APs of the same scan: each AP on the
+ * same channel counts fully, overlapping 2.4 GHz channels count half, and
+ * louder APs weigh more.
+ *
+ * Shared by WifiStation and WifiConfigurationAp so both connect paths pick the
+ * same BSSID for a network.
+ */
+class ApSelector {
+public:
+    explicit ApSelector(const ApSelectionPolicy& policy = ApSelectionPolicy{}) : policy_(policy) {}
+
+    int Score(const wifi_ap_record_t& ap, const wifi_ap_record_t* records, int count) const;
+
+    // Best BSSID advertising `ssid`, nullptr if the scan does not contain it
+    const wifi_ap_record_t* SelectBest(const char* ssid, const wifi_ap_record_t* records, int count) const;
+
+    static bool Is5GHz(uint8_t channel) { return channel > 14; }
+
+    // Load that the APs of a scan put on `channel`, in half units: each AP on it
+    // weighs by how loud it is, overlapping 2.4 GHz channels half as much.
+    // `exclude` skips one BSSID (the AP being ranked).
+    static int ChannelLoad(uint8_t channel, const wifi_ap_record_t* records, int count,
+                           const uint8_t* exclude = nullptr);
+
+    // Least loaded 2.4 GHz channel in [first, last]; 1, 6 and 11, which don't
+    // overlap each other, win ties
+    static ApChannelChoice QuietestChannel(const wifi_ap_record_t* records, int count, uint8_t first, uint8_t last);
+
+private:
+    int CongestionPenalty(const wifi_ap_record_t& ap, const wifi_ap_record_t* records, int count) const;
+
+    ApSelectionPolicy policy_;
+};
+
+#endif // AP_SELECTOR_H
@@ -0,0 +1,29 @@
+#ifndef _DNS_RESPONDER_H_
+#define _DNS_RESPONDER_H_
+
+#include <cstdint>
+
+/**
+ * DnsResponder - Wire-format half of the captive DnsServer
+ *
+ * Turns one query datagram into its response: the gateway address for A (and
+ * ANY) in class IN, an empty NOERROR answer for every other type, nothing for
+ * anything that is not a well-formed standard query. No sockets or IDF calls,
+ * so it is also built and fuzzed on the host (host_test/).
+ */
+class DnsResponder {
+public:
+    static constexpr uint32_t kAnswerTtl = 28;     // Seconds, short so clients re-resolve once online
+
+    // `gateway`: IPv4 address in network byte order (esp_ip4_addr_t::addr)
+    void SetGateway(uint32_t gateway);
+
+    // Returns the response length, or -1 to drop the datagram. The question is
+    // walked with bounds checks, so the response can't outgrow `size`.
+    int BuildResponse(const uint8_t* query, int len, uint8_t* response, int size) const;
+
+private:
+    uint8_t answer_a_[16] = {};    // Precomputed A record for the gateway
+};
+
+#endif // _DNS_RESPONDER_H_
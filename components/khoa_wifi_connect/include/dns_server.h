@@ -1,27 +1,72 @@
 #ifndef _DNS_SERVER_H_
 #define _DNS_SERVER_H_
 
+#include <cstdint>
 #include <string>
 #include <atomic>
 #include <esp_netif_ip_addr.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+#include "dns_responder.h"
+
+/**
+ * DnsServer - Captive portal DNS responder
+ *
+ * Answers every A query with the gateway address and every other type (AAAA,
+ * HTTPS, ...) with an empty NOERROR answer, so clients fall back to IPv4 and
+ * land on the portal. Queries are parsed with bounds checks and answered from
+ * a precomputed record; anything that is not a well-formed standard query is
+ * dropped. Each client is rate-limited, so a phone's burst of connectivity
+ * checks can't starve the others.
+ */
 class DnsServer {
 public:
+    struct Stats {
+        uint32_t queries;        // Datagrams received
+        uint32_t answered_a;     // Answered with the gateway address
+        uint32_t answered_empty; // Answered with no record (AAAA, HTTPS, ...)
+        uint32_t malformed;      // Dropped: not a well-formed standard query
+        uint32_t rate_limited;   // Dropped: client over its rate
+        uint32_t send_errors;
+    };
+
     DnsServer();
     ~DnsServer();
 
     void Start(esp_ip4_addr_t gateway);
     void Stop();
+    Stats GetStats() const;
 
 private:
+    static constexpr int kMaxClients = 8;          // Rate limiter slots, least recently seen is reused
+    static constexpr int kBurstQueries = 32;       // A joining phone sends a few dozen checks at once
+    static constexpr int kQueriesPerSecond = 16;
+
+    struct Client {
+        uint32_t addr;
+        int32_t tokens;
+        TickType_t last_refill;
+    };
+
     int port_ = 53;
     int fd_ = -1;
     esp_ip4_addr_t gateway_;
     std::atomic<bool> running_{false};
     TaskHandle_t task_handle_ = nullptr;
+    std::atomic<TaskHandle_t> stop_waiter_{nullptr};  // Notified by the server task on exit
+    DnsResponder responder_;
+    Client clients_[kMaxClients] = {};                // Server task only
+
+    std::atomic<uint32_t> queries_{0};
+    std::atomic<uint32_t> answered_a_{0};
+    std::atomic<uint32_t> answered_empty_{0};
+    std::atomic<uint32_t> malformed_{0};
+    std::atomic<uint32_t> rate_limited_{0};
+    std::atomic<uint32_t> send_errors_{0};
+
     void Run();
+    bool Admit(uint32_t addr);
 };
 
 #endif // _DNS_SERVER_H_
@@ -0,0 +1,49 @@
+#ifndef _HTTPD_WORKER_POOL_H_
+#define _HTTPD_WORKER_POOL_H_
+
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+/**
+ * HttpdWorkerPool - Runs slow esp_http_server handlers off the httpd task
+ *
+ * Submit() detaches the request with httpd_req_async_handler_begin() and queues
+ * it for one of a few worker tasks, so the single httpd task keeps accepting
+ * and serving other requests (page assets, /scan polls) meanwhile. When the
+ * queue is full the handler simply runs inline, as it would without the pool.
+ *
+ * Stop() lets the workers finish everything already queued, then joins them;
+ * call it before httpd_stop().
+ */
+class HttpdWorkerPool {
+public:
+    using Handler = esp_err_t (*)(httpd_req_t* req);
+
+    HttpdWorkerPool() = default;
+    ~HttpdWorkerPool();
+
+    HttpdWorkerPool(const HttpdWorkerPool&) = delete;
+    HttpdWorkerPool& operator=(const HttpdWorkerPool&) = delete;
+
+    bool Start(int workers, int queue_length, int stack_size, int priority);
+    void Stop();
+
+    // `handler` sees `user_ctx` as req->user_ctx, whichever task it runs on
+    esp_err_t Submit(httpd_req_t* req, Handler handler, void* user_ctx);
+
+private:
+    struct Job {
+        httpd_req_t* req;   // nullptr tells a worker to exit
+        Handler handler;
+    };
+
+    static void WorkerTask(void* arg);
+
+    QueueHandle_t queue_ = nullptr;
+    SemaphoreHandle_t exited_ = nullptr;
+    int workers_ = 0;
+};
+
+#endif // _HTTPD_WORKER_POOL_H_
@@ -0,0 +1,182 @@
+#ifndef _PORTAL_ROUTER_H_
+#define _PORTAL_ROUTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <optional>
+#include <string_view>
+#include <charconv>
+
+#include <esp_http_server.h>
+
+/**
+ * Route table for the config portal's single httpd dispatcher
+ *
+ * The routes are a constexpr array. RouteTable builds a perfect hash over the
+ * exact paths at compile time, searching for a seed with no collisions among
+ * the (method, path) keys, so a lookup costs one hash and one string compare
+ * whatever the number of routes. Paths ending in '*' are prefix routes
+ * (captive probes with varying suffixes); there are only a handful, checked
+ * longest first after the exact lookup misses.
+ *
+ *     static constexpr RouteTable kTable(std::array<PortalRoute, 2>{{...}});
+ *     static_assert(kTable.IsValid());
+ */
+struct PortalRoute {
+    std::string_view path;          // Exact path, or a prefix ending in '*'
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t* req);
+    bool offload;                   // Run on the worker pool (writes NVS, touches the driver)
+};
+
+template <size_t N, size_t M>
+constexpr std::array<PortalRoute, N + M> JoinRoutes(const std::array<PortalRoute, N>& a,
+                                                    const std::array<PortalRoute, M>& b) {
+    std::array<PortalRoute, N + M> routes{};
+    for (size_t i = 0; i < N; i++) {
+        routes[i] = a[i];
+    }
+    for (size_t i = 0; i < M; i++) {
+        routes[N + i] = b[i];
+    }
+    return routes;
+}
+
+template <size_t N>
+class RouteTable {
+public:
+    constexpr explicit RouteTable(const std::array<PortalRoute, N>& routes) : routes_(routes) {
+        static_assert(N < 255, "Slot indexes are 8-bit");
+        for (size_t i = 0; i < N; i++) {
+            if (IsPrefix(routes_[i].path)) {
+                prefixes_[prefix_count_++] = i;
+            }
+        }
+        // Longest prefix first
+        for (size_t i = 1; i < prefix_count_; i++) {
+            for (size_t j = i; j > 0 && routes_[prefixes_[j]].path.size() > routes_[prefixes_[j - 1]].path.size(); j--) {
+                auto tmp = prefixes_[j];
+                prefixes_[j] = prefixes_[j - 1];
+                prefixes_[j - 1] = tmp;
+            }
+        }
+        for (seed_ = 1; seed_ < kMaxSeed; seed_++) {
+            if (TryPlace()) {
+                return;
+            }
+        }
+        seed_ = 0;
+    }
+
+    // False if no collision-free seed was found; static_assert it on the table
+    constexpr bool IsValid() const { return seed_ != 0; }
+
+    // Route for `method` and `path` (query string already stripped), nullptr if none
+    const PortalRoute* Find(httpd_method_t method, std::string_view path) const {
+        uint8_t slot = slots_[Hash(seed_, method, path) & (kSlots - 1)];
+        if (slot != 0) {
+            const PortalRoute& route = routes_[slot - 1];
+            if (route.method == method && route.path == path) {
+                return &route;
+            }
+        }
+        for (size_t i = 0; i < prefix_count_; i++) {
+            const PortalRoute& route = routes_[prefixes_[i]];
+            std::string_view prefix = route.path.substr(0, route.path.size() - 1);
+            if (route.method == method && path.substr(0, prefix.size()) == prefix) {
+                return &route;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    static constexpr size_t kSlots = [] {
+        size_t slots = 1;
+        while (slots < N * 4) {
+            slots <<= 1;
+        }
+        return slots;
+    }();
+    static constexpr uint32_t kMaxSeed = 100000;
+
+    static constexpr bool IsPrefix(std::string_view path) {
+        return !path.empty() && path.back() == '*';
+    }
+
+    // FNV-1a with the seed folded into the offset basis
+    static constexpr uint32_t Hash(uint32_t seed, httpd_method_t method, std::string_view path) {
+        uint32_t hash = 2166136261u ^ (seed * 16777619u);
+        hash = (hash ^ static_cast<uint32_t>(method)) * 16777619u;
+        for (char c : path) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return hash ^ (hash >> 15);
+    }
+
+    constexpr bool TryPlace() {
+        for (auto& slot : slots_) {
+            slot = 0;
+        }
+        for (size_t i = 0; i < N; i++) {
+            if (IsPrefix(routes_[i].path)) {
+                continue;
+            }
+            auto& slot = slots_[Hash(seed_, routes_[i].method, routes_[i].path) & (kSlots - 1)];
+            if (slot != 0) {
+                return false;
+            }
+            slot = i + 1;
+        }
+        return true;
+    }
+
+    std::array<PortalRoute, N> routes_;
+    std::array<uint8_t, kSlots> slots_{};     // Route index + 1, 0 when empty
+    std::array<uint8_t, N> prefixes_{};       // Indexes of the prefix routes
+    size_t prefix_count_ = 0;
+    uint32_t seed_ = 0;
+};
+
+/**
+ * QueryString - Typed access to a request's query parameters
+ *
+ * Copies the query string into a fixed buffer; values are decoded with
+ * httpd_query_key_value() into another one, no heap involved.
+ */
+class QueryString {
+public:
+    explicit QueryString(httpd_req_t* req) {
+        if (httpd_req_get_url_query_str(req, query_, sizeof(query_)) != ESP_OK) {
+            query_[0] = '\0';
+        }
+    }
+
+    std::optional<std::string_view> GetString(const char* key) {
+        if (httpd_query_key_value(query_, key, value_, sizeof(value_)) != ESP_OK) {
+            return std::nullopt;
+        }
+        return std::string_view(value_);
+    }
+
+    template <typename T>
+    std::optional<T> GetNumber(const char* key) {
+        auto text = GetString(key);
+        if (!text) {
+            return std::nullopt;
+        }
+        T value{};
+        auto [end, ec] = std::from_chars(text->data(), text->data() + text->size(), value);
+        if (ec != std::errc() || end != text->data() + text->size()) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+private:
+    char query_[64];
+    char value_[40];
+};
+
+#endif // _PORTAL_ROUTER_H_
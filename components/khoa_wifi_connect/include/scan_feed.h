@@ -0,0 +1,57 @@
+#ifndef _SCAN_FEED_H_
+#define _SCAN_FEED_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "fixed_string.h"
+#include "wifi_scan_service.h"
+
+class JsonWriter;
+
+/**
+ * ScanFeed - The config portal's AP list, kept serialized as JSON
+ *
+ * Update() merges a scan into the published list (one entry per SSID, its
+ * strongest BSSID; hidden networks are left out) and serializes it once into
+ * an immutable buffer that /scan and newly connected event-stream clients
+ * share. It also produces the delta against the previous list for the clients
+ * already connected:
+ *
+ *     {"set":[{"ssid":"...","rssi":-60,"authmode":3}],"remove":["..."]}
+ *
+ * RSSI moves below kRssiHysteresisDb are not reported, so the list on the page
+ * doesn't reshuffle on every scan. Not thread-safe: the portal only uses it
+ * from the httpd task.
+ */
+class ScanFeed {
+public:
+    using Json = std::shared_ptr<const std::string>;
+
+    explicit ScanFeed(bool support_5g);
+
+    // Returns false, leaving `delta` untouched, when no visible change
+    bool Update(const WifiScanResult& result, std::string& delta);
+    // {"support_5g":true,"aps":[...]}, strongest first
+    const Json& GetJson() const { return json_; }
+
+private:
+    static constexpr int kRssiHysteresisDb = 4;
+
+    struct Entry {
+        SsidString ssid;
+        int8_t rssi;
+        uint8_t authmode;
+    };
+
+    static void WriteEntry(JsonWriter& json, const Entry& entry);
+    void Serialize();
+
+    bool support_5g_;
+    std::vector<Entry> entries_;   // What the clients currently show
+    Json json_;
+};
+
+#endif // _SCAN_FEED_H_
@@ -1,35 +1,66 @@
 #ifndef SSID_MANAGER_H
 #define SSID_MANAGER_H
 
-#include <string>
+#include <string_view>
 #include <vector>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "fixed_string.h"
 
 struct SsidItem {
-    std::string ssid;
-    std::string password;
+    SsidString ssid;
+    PasswordString password;
 };
 
+/**
+ * SsidManager - Saved networks, most recently used first
+ *
+ * Persisted as a single versioned, CRC-protected blob ("ssid_list" in the
+ * "wifi" namespace), so boot is one NVS read and a change is one blob write.
+ * Writes are skipped when the serialized list did not change. Lists saved by
+ * older firmware under the "ssid"/"password"..."ssid9"/"password9" keys are
+ * migrated on first boot.
+ *
+ * Thread-safe. Every change publishes a new immutable snapshot; readers take
+ * a reference-counted pointer to the current one and can iterate it without
+ * locks or copies while writers (serialized among themselves) move on.
+ */
 class SsidManager {
 public:
+    using SsidList = std::vector<SsidItem>;
+    using Snapshot = std::shared_ptr<const SsidList>;
+
     static SsidManager& GetInstance() {
         static SsidManager instance;
         return instance;
     }
 
-    void AddSsid(const std::string& ssid, const std::string& password);
+    void AddSsid(std::string_view ssid, std::string_view password);
     void RemoveSsid(int index);
     void SetDefaultSsid(int index);
     void Clear();
-    const std::vector<SsidItem>& GetSsidList() const { return ssid_list_; }
+    Snapshot GetSsidList() const;
 
 private:
     SsidManager();
     ~SsidManager();
 
     void LoadFromNvs();
-    void SaveToNvs();
+    bool LoadLegacyKeys(SsidList& list);
+    void EraseLegacyKeys();
+    void Publish(SsidList&& list);
+    void SaveToNvs(const SsidList& list);
+    static std::vector<uint8_t> Serialize(const SsidList& list);
+    static bool Deserialize(const uint8_t* data, size_t length, SsidList& list);
 
-    std::vector<SsidItem> ssid_list_;
+    // Held across copy, modify, publish and save, so writers never lose each other's changes
+    std::mutex write_mutex_;
+    // Only guards swapping/copying the pointer
+    mutable std::mutex snapshot_mutex_;
+    Snapshot snapshot_ = std::make_shared<const SsidList>();
+    std::vector<uint8_t> saved_blob_;  // Last blob in NVS, to skip writes of unchanged lists
 };
 
 #endif // SSID_MANAGER_H
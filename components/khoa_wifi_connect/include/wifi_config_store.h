@@ -0,0 +1,84 @@
+#ifndef _WIFI_CONFIG_STORE_H_
+#define _WIFI_CONFIG_STORE_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+#include <esp_err.h>
+
+#include "fixed_string.h"
+
+// Advanced settings edited from the web UI, NVS namespace "wifi"
+struct WifiAdvancedConfig {
+    UrlString ota_url;                // "ota_url"
+    UrlString google_sheet_url;       // "gs_url"
+    UrlString google_sheet_url_2;     // "gs_url_2"
+    FixedString<15> vibo_key;         // "vibo_key"
+    int8_t max_tx_power = 0;          // "max_tx_power", 0 = driver default
+    bool remember_bssid = false;      // "remember_bssid"
+    bool sleep_mode = true;           // "sleep_mode"
+};
+
+/**
+ * WifiConfigStore - In-RAM cache of the advanced settings with write-through NVS
+ *
+ * Loaded once (on first access, or explicitly by WifiManager::Initialize once
+ * NVS is up); reads never touch NVS. Update() applies all changes with a single
+ * nvs_commit, writes only keys whose value changed, then notifies subscribers.
+ *
+ * Thread-safe. Subscribers run in the caller's task of Update(), without the
+ * store lock held.
+ */
+class WifiConfigStore {
+public:
+    using ChangeHandler = std::function<void(const WifiAdvancedConfig& old_config,
+                                             const WifiAdvancedConfig& new_config)>;
+
+    static WifiConfigStore& GetInstance() {
+        static WifiConfigStore instance;
+        return instance;
+    }
+
+    void Load();   // (Re)load from NVS
+
+    WifiAdvancedConfig Get();
+    UrlString GetOtaUrl();
+    UrlString GetGoogleSheetUrl1();
+    UrlString GetGoogleSheetUrl2();
+    FixedString<15> GetViboKey();
+    int8_t GetMaxTxPower();
+    bool GetRememberBssid();
+    bool GetSleepMode();
+
+    // Batch update: `mutate` edits a copy, changed keys are committed at once
+    esp_err_t Update(const std::function<void(WifiAdvancedConfig& config)>& mutate);
+
+    int Subscribe(ChangeHandler handler);
+    void Unsubscribe(int id);
+
+    WifiConfigStore(const WifiConfigStore&) = delete;
+    WifiConfigStore& operator=(const WifiConfigStore&) = delete;
+
+private:
+    WifiConfigStore() = default;
+    ~WifiConfigStore() = default;
+
+    void LoadLocked();
+    void EnsureLoadedLocked();
+    esp_err_t SaveLocked(const WifiAdvancedConfig& old_config, const WifiAdvancedConfig& new_config);
+
+    std::mutex mutex_;
+    WifiAdvancedConfig config_;
+    bool loaded_ = false;
+
+    struct Subscriber {
+        int id;
+        ChangeHandler handler;
+    };
+    std::vector<Subscriber> subscribers_;
+    int next_subscriber_id_ = 1;
+};
+
+#endif // _WIFI_CONFIG_STORE_H_
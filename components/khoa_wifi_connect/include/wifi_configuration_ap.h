@@ -2,25 +2,37 @@
 #define _WIFI_CONFIGURATION_AP_H_
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <mutex>
 #include <memory>
+#include <atomic>
 #include <functional>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <esp_http_server.h>
 #include <esp_event.h>
 #include <esp_timer.h>
 #include <esp_netif.h>
 #include <esp_wifi_types_generic.h>
 
+#include "fixed_string.h"
 #include "dns_server.h"
+#include "httpd_worker_pool.h"
+#include "ap_selector.h"
+#include "wifi_scan_service.h"
+#include "scan_feed.h"
 #include "sdkconfig.h"
 
+struct PortalRoute;
+
 /**
  * WifiConfigurationAp - WiFi configuration access point
  * 
  * Creates a WiFi hotspot with a captive portal for configuring WiFi credentials.
  * Note: WiFi driver must be initialized before using this class.
+ * WifiManager creates one per config session and destroys it on exit.
  */
 class WifiConfigurationAp {
 public:
@@ -35,15 +47,41 @@ public:
     void SetSsidPrefix(const std::string &ssid_prefix);
     void SetLanguage(const std::string &&language);
     void SetLanguage(const std::string &language);
-    void Start();
-    void Stop();
+    void SetSelectionPolicy(const ApSelectionPolicy &policy) { selector_ = ApSelector(policy); }
+    // Accept firmware images on POST /ota/upload (the AP is open: service/factory use)
+    void SetFirmwareUpload(bool enabled) { firmware_upload_ = enabled; }
+    // Scan before raising the AP and put it on the least loaded channel
+    void SetChannelSurvey(bool enabled) { channel_survey_ = enabled; }
+    ApChannelChoice GetChannel() const { return channel_; }
+    // `driver_running`: the driver is already started (warm switch from the station)
+    void Start(bool driver_running = false);
+    // `keep_driver`: leave the driver running for the next mode instead of esp_wifi_stop()
+    void Stop(bool keep_driver = false);
+    // Use a netif owned by the caller (from CreateNetif()) instead of creating one
+    void SetNetif(esp_netif_t* netif) { ap_netif_ = netif; owns_netif_ = false; }
+    static esp_netif_t* CreateNetif();
 #if !CONFIG_IDF_TARGET_ESP32P4
     void StartSmartConfig();
 #endif
-    bool ConnectToWifi(const std::string &ssid, const std::string &password);
-    void Save(const std::string &ssid, const std::string &password);
+    bool ConnectToWifi(const SsidString &ssid, const PasswordString &password);
+
+    enum class ConnectJobState { kConnecting, kSucceeded, kFailed };
+    struct ConnectJobStatus {
+        uint32_t id;              // 0 when no job was started this session
+        ConnectJobState state;
+        const char* error;        // Set when the job failed
+    };
+
+    /**
+     * Test the credentials with ConnectToWifi() on a background task and save
+     * them on success, so the HTTP request that asked for it returns at once.
+     * Returns the new job id, or 0 while another attempt is still running.
+     */
+    uint32_t StartConnectJob(const SsidString &ssid, const PasswordString &password);
+    ConnectJobStatus GetConnectJob();
+    void Save(std::string_view ssid, std::string_view password);
     std::vector<wifi_ap_record_t> GetAccessPoints();
-    std::string GetSsid();
+    SsidString GetSsid();
     std::string GetWebServerUrl();
 
     /**
@@ -52,34 +90,123 @@ public:
      */
     void OnExitRequested(std::function<void()> callback);
 
+    /**
+     * Set how ConnectToWifi() borrows the STA interface when the station keeps
+     * running alongside the portal: called with true before the test connect and
+     * with false once it is over
+     */
+    void SetStationControl(std::function<void(bool suspend)> control);
+
 private:
-    std::mutex mutex_;
+    static constexpr int kScanMaxAgeMs = 10000;   // Also the rescan period while pages follow /scan/events
+    static constexpr size_t kMaxScanStreams = 2;   // Each one keeps a socket for itself
+#ifdef CONFIG_SOC_WIFI_SUPPORT_5G
+    static constexpr bool kSupport5g = true;
+#else
+    static constexpr bool kSupport5g = false;
+#endif
+    static constexpr int kMaxOpenSockets = 7;      // LWIP_MAX_SOCKETS (10) minus the 3 httpd keeps
+    static constexpr int kHttpWorkers = 2;
+    static constexpr size_t kMaxSubmitBody = 768;      // {"ssid","password"} fully \u-escaped fits; httpd task stack
+    static constexpr size_t kMaxAdvancedBody = 1024;   // Runs on a worker
+    static constexpr size_t kUploadChunkSize = 4096;   // Firmware upload receive buffer, on the heap
+    static constexpr int kMaxUploadTimeouts = 3;       // Consecutive recv timeouts before giving up
+    static constexpr size_t kMaxUploadStreams = 1;     // /ota/events, only the uploading page needs one
+    static constexpr int kSurveyTimeoutMs = 8000;      // All-channel scan, 5 GHz included on dual-band chips
+#ifdef CONFIG_SOC_WIFI_SUPPORT_5G
+    static constexpr int kConnectTimeoutMs = 25000;  // 5G Network takes longer to connect
+#else
+    static constexpr int kConnectTimeoutMs = 10000;
+#endif
+    static constexpr int kDisconnectTimeoutMs = 1000;  // esp_wifi_disconnect() until its event
+
     std::unique_ptr<DnsServer> dns_server_;
     httpd_handle_t server_ = NULL;
+    HttpdWorkerPool workers_;
     EventGroupHandle_t event_group_;
     std::string ssid_prefix_;
     std::string language_;
     esp_event_handler_instance_t instance_any_id_;
     esp_event_handler_instance_t instance_got_ip_;
-    esp_timer_handle_t scan_timer_ = nullptr;
-    bool is_connecting_ = false;
+    std::atomic<bool> is_connecting_{false};
     esp_netif_t* ap_netif_ = nullptr;
-    std::vector<wifi_ap_record_t> ap_records_;
+    bool owns_netif_ = false;
+    std::atomic<bool> active_{false};  // Guards events already queued when Stop() unregisters
+    ApSelector selector_;
+    std::atomic<uint8_t> last_disconnect_reason_{0};
+    bool firmware_upload_ = false;
+    bool channel_survey_ = true;
+    ApChannelChoice channel_;   // Set by Start()
+    std::atomic<bool> uploading_{false};   // Also keeps the portal from scanning meanwhile
 
-    // 高级配置项
-    int8_t max_tx_power_;
-    bool remember_bssid_;
-    bool sleep_mode_;
-    std::string ota_url_;
-    std::string google_sheet_url_;
-    std::string google_sheet_url_2_;
-    std::string vibo_key_;
+    // Scan feed: only touched from the httpd task (handlers and queued work)
+    ScanFeed scan_feed_{kSupport5g};
+    WifiScanService::Snapshot scan_feed_source_;   // Scan the feed was last updated from
+    std::vector<httpd_req_t*> scan_streams_;       // Open /scan/events responses
+    int scan_listener_ = 0;
+    esp_timer_handle_t scan_timer_ = nullptr;
+
+    struct ConnectJob {
+        ConnectJobStatus status{0, ConnectJobState::kFailed, nullptr};
+        SsidString ssid;
+        PasswordString password;
+        bool running = false;
+        bool stop_requested = false;          // Set by Stop(); checked after the bits are cleared
+        TaskHandle_t stop_waiter = nullptr;   // Stop() waiting for the job task to end
+    };
+    std::mutex job_mutex_;
+    ConnectJob job_;
+    uint32_t next_job_id_ = 1;
+
+    // Firmware upload: written by the worker running /ota/upload, pushed to the
+    // /ota/events streams from the httpd task
+    enum class UploadState { kIdle, kReceiving, kVerifying, kSucceeded, kFailed };
+    struct UploadStatus {
+        UploadState state = UploadState::kIdle;
+        size_t received = 0;
+        size_t total = 0;
+        const char* error = nullptr;    // Set when the upload failed
+    };
+    std::mutex upload_mutex_;
+    UploadStatus upload_;
+    std::vector<httpd_req_t*> upload_streams_;     // httpd task only
 
     // Callbacks
     std::function<void()> on_exit_requested_;
+    std::function<void(bool suspend)> station_control_;
 
-    void StartAccessPoint();
+    void StartAccessPoint(bool driver_running);
+    void SurveyChannel();
+    void ReleaseInterface();
     void StartWebServer();
+    void RequestExit(int delay_ms);
+    void RefreshScan(const WifiScanService::Snapshot& results);
+    void SyncScanFeed();
+    esp_err_t OpenScanStream(httpd_req_t *req);
+    void PushScanEvent(const char* event, const std::string& data);
+    void CloseEventStreams();
+    const char* ReceiveFirmware(httpd_req_t *req);
+    void SetUploadStatus(const UploadStatus& status);
+    void PushUploadEvent();
+    void StopConnectJob();
+    static void ConnectJobTask(void* arg);
+
+    // HTTP: a single registered dispatcher, routes are a constexpr table in the .cc
+    static const PortalRoute* FindRoute(httpd_method_t method, std::string_view path);
+    static esp_err_t Dispatch(httpd_req_t *req);
+    static esp_err_t HandleCaptiveProbe(httpd_req_t *req);
+    static esp_err_t HandleSavedList(httpd_req_t *req);
+    static esp_err_t HandleSavedSetDefault(httpd_req_t *req);
+    static esp_err_t HandleSavedDelete(httpd_req_t *req);
+    static esp_err_t HandleScan(httpd_req_t *req);
+    static esp_err_t HandleScanEvents(httpd_req_t *req);
+    static esp_err_t HandleSubmit(httpd_req_t *req);
+    static esp_err_t HandleSubmitStatus(httpd_req_t *req);
+    static esp_err_t HandleExit(httpd_req_t *req);
+    static esp_err_t HandleAdvancedConfig(httpd_req_t *req);
+    static esp_err_t HandleAdvancedSubmit(httpd_req_t *req);
+    static esp_err_t HandleOtaUpload(httpd_req_t *req);
+    static esp_err_t HandleOtaEvents(httpd_req_t *req);
 
     // Event handlers
     static void WifiEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
@@ -2,20 +2,25 @@
  * WiFi Manager - Unified WiFi connection management
  * 
  * Thread Safety:
- * - All public methods are thread-safe (protected by internal mutex)
- * - Event callback is invoked from WiFi event task
+ * - All public methods are thread-safe
+ * - Mode transitions (Start/Stop Station/ConfigAp) are commands executed in order
+ *   by the "wifi_mgr" worker task; the calls only enqueue and return at once.
+ *   The returned future becomes ready when the command has been applied. Do not
+ *   wait on it from an event subscriber: events may be published by the worker.
+ * - Event subscribers are invoked from the WiFi event task, or from the
+ *   "wifi_mgr_evt" task when dedicated_event_loop is enabled
  * 
  * Usage:
  *   auto& wifi = WifiManager::GetInstance();
  *   
  *   EventGroupHandle_t events = xEventGroupCreate();
- *   wifi.SetEventCallback([events](WifiEvent e) {
- *       if (e == WifiEvent::Connected) xEventGroupSetBits(events, BIT0);
- *       if (e == WifiEvent::ConfigModeExit) xEventGroupSetBits(events, BIT1);
+ *   wifi.Subscribe([events](const WifiEventInfo& e) {
+ *       if (e.event == WifiEvent::Connected) xEventGroupSetBits(events, BIT0);
+ *       if (e.event == WifiEvent::ConfigModeExit) xEventGroupSetBits(events, BIT1);
  *   });
  *   
  *   wifi.Initialize(config);
- *   wifi.StartStation();
+ *   wifi.StartStation();          // or wifi.StartStation().wait() to block until started
  *   xEventGroupWaitBits(events, BIT0 | BIT1, pdTRUE, pdFALSE, portMAX_DELAY);
  */
 
@@ -23,11 +28,21 @@
 #define _WIFI_MANAGER_H_
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <functional>
 #include <mutex>
+#include <future>
 
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "fixed_string.h"
 #include "wifi_station.h"
+#include "wifi_metrics.h"
 
 class WifiStation;
 class WifiConfigurationAp;
@@ -42,6 +57,21 @@ enum class WifiEvent {
     ConfigModeExit,    // Exited config AP mode
 };
 
+// Event payload, plain data so it can be posted through an esp_event loop
+struct WifiEventInfo {
+    WifiEvent event;
+    char ssid[33];               // Target/connected SSID, or AP SSID for config mode events
+    char ip_address[16];         // Connected only
+    int8_t rssi;                 // Connected only
+    uint8_t channel;             // Connected only
+    uint8_t disconnect_reason;   // Disconnected only, wifi_err_reason_t (0 when stopped locally)
+};
+
+using WifiEventHandler = std::function<void(const WifiEventInfo& info)>;
+
+// esp_event base used on the dedicated loop, event id = WifiEvent, data = WifiEventInfo
+ESP_EVENT_DECLARE_BASE(WIFI_MANAGER_EVENT);
+
 // Configuration
 struct WifiManagerConfig {
     std::string ssid_prefix = "ESP32";    // AP mode SSID prefix
@@ -50,6 +80,49 @@ struct WifiManagerConfig {
     // Station mode scan interval with exponential backoff
     int station_scan_min_interval_seconds = 10;   // Initial scan interval (fast retry)
     int station_scan_max_interval_seconds = 300;  // Maximum scan interval (5 minutes)
+
+    // Deliver events from a dedicated esp_event loop task instead of the system
+    // event task, so slow subscribers never delay WiFi event processing
+    bool dedicated_event_loop = false;
+    int event_task_stack_size = 4096;
+    int event_task_priority = 5;
+
+    // Remember the last good BSSID/channel in NVS and connect to it directly after
+    // a reboot, skipping the initial scan
+    bool fast_reconnect = true;
+
+    // BSSID ranking shared by station and config AP (5 GHz margin, congestion penalty)
+    ApSelectionPolicy ap_selection;
+
+    // Automatic power save while connected: the idle level is used when no transfer
+    // is active, BeginTransfer()/EndTransfer() raise it to PERFORMANCE (e.g. during OTA).
+    // Disabling "sleep_mode" in the web UI forces PERFORMANCE when idle as well.
+    WifiPowerSaveLevel idle_power_save = WifiPowerSaveLevel::LOW_POWER;
+    int idle_listen_interval = 3;   // Beacon intervals between wake-ups in LOW_POWER (~300 ms)
+
+    // Keep the station associated (data, OTA) while the config AP and portal run,
+    // the AP then shares the station's channel. The portal's test connect suspends
+    // the station for its duration instead of tearing it down.
+    bool concurrent_config_ap = false;
+
+    // Scan before starting the config AP and put it on the least loaded 2.4 GHz
+    // channel (adds the scan time to the AP start). A concurrent, associated
+    // station imposes its own channel instead.
+    bool ap_channel_survey = true;
+
+    // Let the portal flash firmware uploaded to POST /ota/upload (through OtaManager).
+    // The config AP is open, so anyone who joins it could reflash the device:
+    // meant for factory and service builds.
+    bool firmware_upload = false;
+
+    // Switch between station and config AP by changing only the driver mode: netifs
+    // and event handlers stay registered and the driver is not restarted
+    bool warm_mode_switch = true;
+
+    // Worker task that executes mode transitions from a bounded command queue
+    int command_queue_length = 8;
+    int worker_task_stack_size = 4096;
+    int worker_task_priority = 5;
 };
 
 /**
@@ -66,38 +139,56 @@ public:
 
     // ==================== Station Mode ====================
     
-    void StartStation();   // Non-blocking, auto-stops config AP if active
-    void StopStation();    // Non-blocking
+    std::future<void> StartStation();   // Non-blocking, auto-stops config AP if active
+    std::future<void> StopStation();    // Non-blocking
     
     bool IsConnected() const;
-    std::string GetSsid() const;
-    std::string GetIpAddress() const;
+    SsidString GetSsid() const;
+    IpAddressString GetIpAddress() const;
     int GetRssi() const;
     int GetChannel() const;
-    std::string GetMacAddress() const;
+    MacAddressString GetMacAddress() const;
+
+    // ==================== Diagnostics ====================
+
+    // Per-attempt timings (scan, association, DHCP, disconnect reason) and aggregates
+    WifiConnectionStats GetConnectionStats() const;
+    std::vector<WifiConnectAttempt> GetConnectionHistory() const;  // Oldest first
+    void ResetConnectionStats();
 
     // ==================== Config AP Mode ====================
     
-    void StartConfigAp();  // Non-blocking, auto-stops station if active
-    void StopConfigAp();   // Non-blocking
+    std::future<void> StartConfigAp();  // Non-blocking, auto-stops station if active
+    std::future<void> StopConfigAp();   // Non-blocking
     
     bool IsConfigMode() const;
-    std::string GetApSsid() const;
+    SsidString GetApSsid() const;
     std::string GetApWebUrl() const;
+    ApChannelChoice GetApChannel() const;   // Channel and survey load of the running config AP
 
     // ==================== Power ====================
     
-    void SetPowerSaveLevel(WifiPowerSaveLevel level);
+    void SetPowerSaveLevel(WifiPowerSaveLevel level);  // Level used while idle
+
+    // Declare a heavy transfer; power save is disabled until the matching EndTransfer()
+    void BeginTransfer();
+    void EndTransfer();
 
     // ==================== Configuration Getters ====================
-    
-    std::string GetViboKey() const;
-    std::string GetGoogleSheetUrl1() const;
-    std::string GetGoogleSheetUrl2() const;
-    std::string GetOtaUrl() const;
+
+    // Served from WifiConfigStore's RAM cache, cheap enough for hot loops
+    FixedString<15> GetViboKey() const;
+    UrlString GetGoogleSheetUrl1() const;
+    UrlString GetGoogleSheetUrl2() const;
+    UrlString GetOtaUrl() const;
 
     // ==================== Event ====================
     
+    // Multiple subscribers; returns an id for Unsubscribe()
+    int Subscribe(WifiEventHandler handler);
+    void Unsubscribe(int id);
+
+    // Single-callback shortcut, replaces the previous callback set through this method
     void SetEventCallback(std::function<void(WifiEvent)> callback);
 
     const WifiManagerConfig& GetConfig() const { return config_; }
@@ -109,19 +200,91 @@ private:
     WifiManager();
     ~WifiManager();
 
+    struct Subscriber {
+        int id;
+        WifiEventHandler handler;
+    };
+    using SubscriberList = std::vector<Subscriber>;
+
+    enum class Command : uint8_t {
+        StartStation,
+        StopStation,
+        StartConfigAp,
+        StopConfigAp,
+    };
+    // Queued by value; `done` is owned by the worker once the send succeeded
+    struct CommandMessage {
+        Command command;
+        std::promise<void>* done;
+    };
+
+    std::future<void> Post(Command command);
+    static void WorkerTask(void* arg);
+    // Run on the worker task only, so transitions never interleave
+    void DoStartStation();
+    void DoStopStation(bool keep_driver = false);
+    void DoStartConfigAp();
+    void DoStopConfigAp(bool keep_driver = false);
+
+    void SetApRunning(bool running);
     void NotifyEvent(WifiEvent event);
+    void Publish(const WifiEventInfo& info);
+    void Dispatch(const WifiEventInfo& info);
+    static void EventLoopHandler(void* arg, esp_event_base_t base, int32_t id, void* data);
+    void SetLinkUp(bool up);
+    void ApplyPowerSaveLocked();
 
     WifiManagerConfig config_;
     std::unique_ptr<WifiStation> station_;
-    std::unique_ptr<WifiConfigurationAp> config_ap_;
+    std::unique_ptr<WifiConfigurationAp> config_ap_;   // Only while the config AP runs
+    esp_netif_t* ap_netif_ = nullptr;                    // Kept across sessions with warm_mode_switch
+    uint32_t portal_heap_baseline_ = 0;
+    WifiMetrics metrics_;  // Own lock, safe to update from the WiFi event task
+
+    QueueHandle_t command_queue_ = nullptr;
+    TaskHandle_t worker_task_ = nullptr;
 
-    mutable std::mutex mutex_;
+    mutable std::mutex mutex_;   // Guards the state below against the getters
     bool initialized_ = false;
     bool station_active_ = false;
     bool config_mode_active_ = false;
+    bool driver_running_ = false;   // esp_wifi_start() done and not stopped (worker only)
+
+    // Copy-on-write subscriber list; publishing only holds subscribers_mutex_ to copy the pointer
+    std::mutex subscribers_mutex_;
+    std::shared_ptr<const SubscriberList> subscribers_ = std::make_shared<SubscriberList>();
+    int next_subscriber_id_ = 1;
+    int callback_subscriber_id_ = 0;
+    int config_subscriber_id_ = 0;   // WifiConfigStore change subscription
+    esp_event_loop_handle_t event_loop_ = nullptr;
+
+    mutable MacAddressString mac_address_;
+
+    // Power save controller, separate lock so event callbacks never wait on mode changes
+    std::mutex power_mutex_;
+    WifiPowerSaveLevel idle_power_save_ = WifiPowerSaveLevel::LOW_POWER;
+    WifiPowerSaveLevel applied_power_save_ = WifiPowerSaveLevel::BALANCED;
+    bool power_save_applied_ = false;
+    bool link_up_ = false;
+    bool ap_running_ = false;   // The soft-AP does not work with modem sleep
+    int active_transfers_ = 0;
+};
+
+/**
+ * WifiTransferGuard - Keeps power save disabled for the lifetime of the guard
+ *
+ *   {
+ *       WifiTransferGuard guard;
+ *       download_file();
+ *   }
+ */
+class WifiTransferGuard {
+public:
+    WifiTransferGuard() { WifiManager::GetInstance().BeginTransfer(); }
+    ~WifiTransferGuard() { WifiManager::GetInstance().EndTransfer(); }
 
-    std::function<void(WifiEvent)> event_callback_;
-    mutable std::string mac_address_;
+    WifiTransferGuard(const WifiTransferGuard&) = delete;
+    WifiTransferGuard& operator=(const WifiTransferGuard&) = delete;
 };
 
 #endif // _WIFI_MANAGER_H_
@@ -0,0 +1,91 @@
+#ifndef _WIFI_METRICS_H_
+#define _WIFI_METRICS_H_
+
+#include <cstdint>
+#include <vector>
+#include <mutex>
+
+// One esp_wifi_connect() try, reported by WifiStation when it succeeds or fails
+struct WifiConnectAttempt {
+    int64_t timestamp_us;        // esp_timer time the attempt started
+    char ssid[33];
+    uint8_t bssid[6];
+    uint32_t scan_ms;            // Scan that selected this AP, 0 for retries
+    uint32_t assoc_ms;           // Connect -> associated, 0 if never associated
+    uint32_t dhcp_ms;            // Associated -> got IP, 0 if no IP
+    uint8_t disconnect_reason;   // wifi_err_reason_t of a failed attempt, 0 on success
+    uint8_t reconnects;          // Retry index on the same AP
+    bool success;
+    bool cached_credentials;     // STA config kept, so the supplicant could reuse its PMK cache
+};
+
+// Aggregate counters since boot
+struct WifiConnectionStats {
+    uint32_t attempts;
+    uint32_t successes;
+    uint32_t failures;
+    uint32_t reconnects;         // Retries on the same AP
+    uint32_t disconnects;        // Established sessions that dropped
+    uint32_t avg_scan_ms;
+    uint32_t avg_assoc_ms;
+    uint32_t avg_dhcp_ms;
+    uint32_t max_connect_ms;     // Worst assoc + dhcp of a successful attempt
+    uint32_t full_handshake_ms;  // Average association time without cached credentials
+    uint32_t cached_handshake_ms; // Average association time with cached credentials
+    uint32_t cache_hits;         // Successful associations with cached credentials
+    uint32_t handshake_saved_ms; // Estimated total time saved by the credential cache
+    uint32_t mode_switches;      // Completed StartStation/StartConfigAp transitions
+    uint32_t last_switch_ms;     // Command dequeued -> new mode started
+    uint32_t avg_switch_ms;
+    uint32_t max_switch_ms;
+    int64_t last_connected_us;
+    int64_t last_disconnected_us;
+    uint8_t last_disconnect_reason;
+
+    static constexpr int kMaxReasons = 8;
+    struct ReasonCount {
+        uint8_t reason;
+        uint16_t count;
+    } reasons[kMaxReasons];      // Most frequent disconnect reasons, unsorted
+    int reason_count;
+};
+
+/**
+ * WifiMetrics - Fixed-size ring buffer of connection attempts plus aggregates
+ *
+ * Thread-safe; Record* is called from the WiFi event task and holds the lock
+ * only for a copy into the ring.
+ */
+class WifiMetrics {
+public:
+    static constexpr int kCapacity = 16;
+
+    void RecordAttempt(const WifiConnectAttempt& attempt);
+    void RecordDisconnect(uint8_t reason);
+    void RecordModeSwitch(uint32_t duration_ms);
+
+    WifiConnectionStats GetStats() const;
+    std::vector<WifiConnectAttempt> GetRecentAttempts() const;  // Oldest first
+    void Reset();
+
+private:
+    void CountReason(uint8_t reason);
+
+    mutable std::mutex mutex_;
+    WifiConnectAttempt ring_[kCapacity] = {};
+    int head_ = 0;
+    int size_ = 0;
+
+    WifiConnectionStats stats_ = {};
+    uint64_t total_scan_ms_ = 0;
+    uint32_t scan_samples_ = 0;
+    uint64_t total_assoc_ms_ = 0;
+    uint32_t assoc_samples_ = 0;
+    uint64_t total_dhcp_ms_ = 0;
+    uint64_t total_full_handshake_ms_ = 0;
+    uint32_t full_handshake_samples_ = 0;
+    uint64_t total_cached_handshake_ms_ = 0;
+    uint64_t total_switch_ms_ = 0;
+};
+
+#endif // _WIFI_METRICS_H_
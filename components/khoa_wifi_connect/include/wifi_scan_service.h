@@ -0,0 +1,82 @@
+#ifndef _WIFI_SCAN_SERVICE_H_
+#define _WIFI_SCAN_SERVICE_H_
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+#include <esp_event.h>
+#include <esp_wifi_types_generic.h>
+
+// Results of one completed scan
+struct WifiScanResult {
+    int64_t timestamp_us;                    // esp_timer time the scan finished
+    std::vector<wifi_ap_record_t> records;
+
+    int AgeMs() const;
+};
+
+/**
+ * WifiScanService - Single owner of esp_wifi_scan_start() and the scan results
+ *
+ * The driver hands out the records of a scan only once, so every consumer
+ * (station, config portal) goes through this service: requests made while a
+ * scan is running join it instead of starting another, and the last results
+ * are cached as an immutable snapshot with a timestamp.
+ *
+ * Completion callbacks run in the WiFi event task without the service lock.
+ * They receive nullptr when the scan failed or was aborted.
+ *
+ * Listeners see every completed scan, whoever requested it. They also run in
+ * the event task, under a lock of their own so that RemoveListener() can wait
+ * for a running call; keep them short.
+ */
+class WifiScanService {
+public:
+    using Snapshot = std::shared_ptr<const WifiScanResult>;
+    using ScanCallback = std::function<void(const Snapshot& results)>;
+
+    static WifiScanService& GetInstance() {
+        static WifiScanService instance;
+        return instance;
+    }
+
+    void Start();   // Register the SCAN_DONE handler, the driver must be initialized
+    void Stop();
+
+    // Start a scan, or join the running one. Returns false if the driver refused
+    // (e.g. busy connecting); `done` is then never called.
+    bool RequestScan(ScanCallback done = nullptr);
+    bool IsScanning();
+
+    Snapshot GetResults();   // Last completed scan, nullptr if none
+    void Clear();            // Drop the cached results
+
+    int AddListener(ScanCallback listener);   // Returns an id for RemoveListener()
+    // Once it returns the listener is not running and will not be called again
+    void RemoveListener(int id);
+
+    WifiScanService(const WifiScanService&) = delete;
+    WifiScanService& operator=(const WifiScanService&) = delete;
+
+private:
+    WifiScanService() = default;
+    ~WifiScanService() = default;
+
+    static void ScanDoneHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
+
+    std::mutex mutex_;
+    esp_event_handler_instance_t instance_scan_done_ = nullptr;
+    bool scanning_ = false;
+    std::vector<ScanCallback> waiters_;
+    Snapshot results_;
+
+    std::mutex listeners_mutex_;
+    std::vector<std::pair<int, ScanCallback>> listeners_;
+    int next_listener_id_ = 1;
+};
+
+#endif // _WIFI_SCAN_SERVICE_H_
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 #include <functional>
 
 #include <esp_event.h>
@@ -10,6 +11,11 @@
 #include <esp_netif.h>
 #include <esp_wifi_types_generic.h>
 
+#include "fixed_string.h"
+#include "wifi_metrics.h"
+#include "ap_selector.h"
+#include "wifi_scan_service.h"
+
 // WiFi power save level enumeration
 enum class WifiPowerSaveLevel {
     LOW_POWER,    // Maximum power saving (WIFI_PS_MAX_MODEM)
@@ -18,11 +24,12 @@ enum class WifiPowerSaveLevel {
 };
 
 struct WifiApRecord {
-    std::string ssid;
-    std::string password;
+    SsidString ssid;
+    PasswordString password;
     int channel;
     wifi_auth_mode_t authmode;
     uint8_t bssid[6];
+    int8_t rssi;
 };
 
 /**
@@ -41,20 +48,31 @@ public:
     WifiStation& operator=(const WifiStation&) = delete;
 
     void AddAuth(const std::string &&ssid, const std::string &&password);
-    void Start();
-    void Stop();
+    // `driver_running`: the driver is already started (warm switch from the config AP)
+    void Start(bool driver_running = false);
+    // `keep_driver`: leave the driver running for the next mode instead of esp_wifi_stop()
+    void Stop(bool keep_driver = false);
     bool IsConnected();
     bool WaitForConnected(int timeout_ms = 10000);
     int8_t GetRssi();
-    std::string GetSsid() const { return ssid_; }
-    std::string GetIpAddress() const { return ip_address_; }
+    const SsidString& GetSsid() const { return ssid_; }
+    const IpAddressString& GetIpAddress() const { return ip_address_; }
     uint8_t GetChannel();
     void SetPowerSaveLevel(WifiPowerSaveLevel level);
+    void SetListenInterval(int listen_interval) { listen_interval_ = listen_interval; }
+    void SetFastReconnect(bool enable) { fast_reconnect_ = enable; }
+    void SetSelectionPolicy(const ApSelectionPolicy& policy) { selector_ = ApSelector(policy); }
+    // Keep the netif and event handlers registered across Stop()/Start()
+    void SetWarmSwitch(bool enable) { warm_switch_ = enable; }
+    // Hand the STA interface to someone else (portal test-connect) and take it back
+    void Suspend();
+    void Resume();
 
-    void OnConnect(std::function<void(const std::string& ssid)> on_connect);
-    void OnConnected(std::function<void(const std::string& ssid)> on_connected);
-    void OnDisconnected(std::function<void()> on_disconnected);
+    void OnConnect(std::function<void(const SsidString& ssid)> on_connect);
+    void OnConnected(std::function<void(const SsidString& ssid)> on_connected);
+    void OnDisconnected(std::function<void(uint8_t reason)> on_disconnected);
     void OnScanBegin(std::function<void()> on_scan_begin);
+    void OnAttemptFinished(std::function<void(const WifiConnectAttempt& attempt)> on_attempt_finished);
     void SetScanIntervalRange(int min_interval_seconds, int max_interval_seconds);
 
 private:
@@ -62,30 +80,73 @@ private:
     esp_timer_handle_t timer_handle_ = nullptr;
     esp_event_handler_instance_t instance_any_id_ = nullptr;
     esp_event_handler_instance_t instance_got_ip_ = nullptr;
+    esp_event_handler_instance_t instance_resume_ = nullptr;
     esp_netif_t* station_netif_ = nullptr;
-    std::string ssid_;
-    std::string password_;
-    std::string ip_address_;
-    int8_t max_tx_power_;
-    uint8_t remember_bssid_;
+    bool warm_switch_ = false;
+    std::atomic<bool> active_{false};  // Handlers stay registered while stopped in warm mode
+    std::atomic<bool> suspended_{false};
+    std::atomic<bool> scan_pending_{false};  // Waiting for a WifiScanService completion
+    std::atomic<bool> resume_pending_{false};  // Resume() posted, not yet handled on the event task
+    SsidString ssid_;
+    PasswordString password_;
+    IpAddressString ip_address_;
+    bool remember_bssid_ = false;      // Snapshot of WifiConfigStore at Start()
+    int listen_interval_ = 3;
+    uint8_t channel_ = 0;              // Channel of the current association
+    wifi_auth_mode_t authmode_ = WIFI_AUTH_OPEN;
+
+    // Credential reuse: the supplicant keeps its PMK/SAE cache only while the STA
+    // config is unchanged, and after a reboot we go straight to the last good BSSID
+    struct LastAp {
+        char ssid[33];
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint8_t authmode;
+    };
+    static constexpr int kMaxAssociatedBssids = 4;
+    bool fast_reconnect_ = true;
+    bool fast_connect_attempt_ = false;   // Current attempt uses the persisted last AP, no scan
+    bool config_reused_ = false;          // Current attempt kept the previous STA config
+    LastAp last_ap_ = {};
+    uint8_t associated_bssids_[kMaxAssociatedBssids][6] = {};  // BSSIDs associated since boot
+    int associated_bssid_count_ = 0;
     int reconnect_count_ = 0;
+    uint8_t bssid_[6] = {0};           // BSSID of the current attempt
+    int64_t connect_start_us_ = 0;     // esp_wifi_connect() of the current attempt
+    int64_t associated_us_ = 0;        // WIFI_EVENT_STA_CONNECTED of the current attempt
+    int64_t scan_start_us_ = 0;
+    uint32_t pending_scan_ms_ = 0;     // Duration of the scan, reported with the first attempt after it
+    uint32_t attempt_scan_ms_ = 0;
     
     // Exponential backoff for scan interval
     int scan_min_interval_microseconds_ = 10 * 1000 * 1000;   // Default 10 seconds
     int scan_max_interval_microseconds_ = 300 * 1000 * 1000;  // Default 5 minutes
     int scan_current_interval_microseconds_ = 10 * 1000 * 1000;  // Current interval
-    std::function<void(const std::string& ssid)> on_connect_;
-    std::function<void(const std::string& ssid)> on_connected_;
-    std::function<void()> on_disconnected_;
+    std::function<void(const SsidString& ssid)> on_connect_;
+    std::function<void(const SsidString& ssid)> on_connected_;
+    std::function<void(uint8_t reason)> on_disconnected_;
     std::function<void()> on_scan_begin_;
+    std::function<void(const WifiConnectAttempt& attempt)> on_attempt_finished_;
     std::vector<WifiApRecord> connect_queue_;
+    ApSelector selector_;
     bool was_connected_ = false;  // Track if we were connected before disconnection
 
-    void HandleScanResult();
+    void OnScanDone(const WifiScanService::Snapshot& results);
+    void HandleScanResult(const WifiScanService::Snapshot& results);
     void StartConnect();
     void UpdateScanInterval();  // Exponential backoff for scan interval
+    void StartScan();
+    void BeginAttempt();
+    void FinishAttempt(bool success, uint8_t reason);
+    bool ApplyStaConfig(wifi_config_t& config);
+    bool TryFastConnect();
+    void RememberAssociation();
+    bool WasAssociated(const uint8_t bssid[6]) const;
+    void OnStarted();
+    void ReleaseInterface();
     static void WifiEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
     static void IpEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
+    static void ResumeEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 };
 
 #endif // _WIFI_STATION_H_
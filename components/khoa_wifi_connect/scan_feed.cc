@@ -0,0 +1,97 @@
+#include "scan_feed.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+#include "json_stream.h"
+
+// JsonWriter sink growing a std::string
+static bool AppendTo(void* ctx, const char* data, size_t length) {
+    static_cast<std::string*>(ctx)->append(data, length);
+    return true;
+}
+
+ScanFeed::ScanFeed(bool support_5g) : support_5g_(support_5g) {
+    Serialize();
+}
+
+bool ScanFeed::Update(const WifiScanResult& result, std::string& delta) {
+    std::vector<Entry> latest;
+    latest.reserve(result.records.size());
+    for (const auto& record : result.records) {
+        const char* ssid = reinterpret_cast<const char*>(record.ssid);
+        if (ssid[0] == '\0') {
+            continue;
+        }
+        auto it = std::find_if(latest.begin(), latest.end(),
+                               [ssid](const Entry& entry) { return entry.ssid == ssid; });
+        if (it == latest.end()) {
+            latest.push_back({SsidString(ssid), record.rssi, static_cast<uint8_t>(record.authmode)});
+        } else if (record.rssi > it->rssi) {
+            it->rssi = record.rssi;
+            it->authmode = record.authmode;
+        }
+    }
+
+    std::string changes;
+    char buf[64];
+    JsonWriter json(buf, sizeof(buf), AppendTo, &changes);
+    int changed = 0;
+    json.BeginObject().Key("set").BeginArray();
+    for (auto& entry : latest) {
+        auto old = std::find_if(entries_.begin(), entries_.end(),
+                                [&entry](const Entry& e) { return e.ssid == entry.ssid; });
+        if (old != entries_.end() && old->authmode == entry.authmode &&
+            std::abs(old->rssi - entry.rssi) < kRssiHysteresisDb) {
+            entry.rssi = old->rssi;   // Keep what the clients show
+            continue;
+        }
+        WriteEntry(json, entry);
+        changed++;
+    }
+
+    json.EndArray().Key("remove").BeginArray();
+    for (const auto& old : entries_) {
+        bool gone = std::none_of(latest.begin(), latest.end(),
+                                 [&old](const Entry& e) { return e.ssid == old.ssid; });
+        if (gone) {
+            json.String(old.ssid);
+            changed++;
+        }
+    }
+    json.EndArray().EndObject();
+
+    if (changed == 0 || !json.Finish()) {
+        return false;
+    }
+
+    std::stable_sort(latest.begin(), latest.end(),
+                     [](const Entry& a, const Entry& b) { return a.rssi > b.rssi; });
+    entries_ = std::move(latest);
+    Serialize();
+
+    delta = std::move(changes);
+    return true;
+}
+
+void ScanFeed::Serialize() {
+    auto text = std::make_shared<std::string>();
+    text->reserve(32 + entries_.size() * 64);
+    char buf[64];
+    JsonWriter json(buf, sizeof(buf), AppendTo, text.get());
+    json.BeginObject().Key("support_5g").Bool(support_5g_).Key("aps").BeginArray();
+    for (const auto& entry : entries_) {
+        WriteEntry(json, entry);
+    }
+    json.EndArray().EndObject();
+    json.Finish();
+    json_ = std::move(text);
+}
+
+void ScanFeed::WriteEntry(JsonWriter& json, const Entry& entry) {
+    json.BeginObject()
+        .Key("ssid").String(entry.ssid)
+        .Key("rssi").Int(entry.rssi)
+        .Key("authmode").Int(entry.authmode)
+        .EndObject();
+}
@@ -1,12 +1,34 @@
 #include "ssid_manager.h"
 
 #include <algorithm>
+#include <cstring>
+#include <string>
 #include <esp_log.h>
+#include <esp_rom_crc.h>
 #include <nvs_flash.h>
 
 #define TAG "SsidManager"
 #define NVS_NAMESPACE "wifi"
-#define MAX_WIFI_SSID_COUNT 10
+#define NVS_BLOB_KEY "ssid_list"
+#define MAX_WIFI_SSID_COUNT 64
+#define LEGACY_SSID_COUNT 10      // "ssid".."ssid9" keys of the old format
+
+// Blob layout (little endian):
+//   BlobHeader, then `count` records of
+//   [ssid_len u8][ssid bytes][password_len u8][password bytes]
+// crc32 covers the records only.
+#define BLOB_VERSION 1
+#define MAX_SSID_LENGTH 32
+#define MAX_PASSWORD_LENGTH 64
+
+struct BlobHeader {
+    uint16_t version;
+    uint16_t count;
+    uint32_t crc32;
+};
+
+static constexpr size_t kMaxRecordSize = 2 + MAX_SSID_LENGTH + MAX_PASSWORD_LENGTH;
+static constexpr size_t kMaxBlobSize = sizeof(BlobHeader) + MAX_WIFI_SSID_COUNT * kMaxRecordSize;
 
 SsidManager::SsidManager() {
     LoadFromNvs();
@@ -15,17 +37,86 @@ SsidManager::SsidManager() {
 SsidManager::~SsidManager() {
 }
 
+SsidManager::Snapshot SsidManager::GetSsidList() const {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return snapshot_;
+}
+
+void SsidManager::Publish(SsidList&& list) {
+    auto snapshot = std::make_shared<const SsidList>(std::move(list));
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    snapshot_ = std::move(snapshot);
+}
+
 void SsidManager::Clear() {
-    ssid_list_.clear();
-    SaveToNvs();
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    SaveToNvs(SsidList());
+    Publish(SsidList());
+}
+
+std::vector<uint8_t> SsidManager::Serialize(const SsidList& list) {
+    std::vector<uint8_t> blob(sizeof(BlobHeader));
+    for (const auto& item : list) {
+        size_t ssid_length = std::min(item.ssid.size(), (size_t)MAX_SSID_LENGTH);
+        size_t password_length = std::min(item.password.size(), (size_t)MAX_PASSWORD_LENGTH);
+        blob.push_back((uint8_t)ssid_length);
+        blob.insert(blob.end(), item.ssid.begin(), item.ssid.begin() + ssid_length);
+        blob.push_back((uint8_t)password_length);
+        blob.insert(blob.end(), item.password.begin(), item.password.begin() + password_length);
+    }
+
+    BlobHeader header = {};
+    header.version = BLOB_VERSION;
+    header.count = (uint16_t)list.size();
+    header.crc32 = esp_rom_crc32_le(0, blob.data() + sizeof(BlobHeader), blob.size() - sizeof(BlobHeader));
+    memcpy(blob.data(), &header, sizeof(header));
+    return blob;
+}
+
+bool SsidManager::Deserialize(const uint8_t* data, size_t length, SsidList& out) {
+    BlobHeader header;
+    if (length < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.version != BLOB_VERSION || header.count > MAX_WIFI_SSID_COUNT) {
+        ESP_LOGW(TAG, "Unsupported SSID blob version %d, count %d", header.version, header.count);
+        return false;
+    }
+    const uint8_t* p = data + sizeof(header);
+    const uint8_t* end = data + length;
+    if (esp_rom_crc32_le(0, p, end - p) != header.crc32) {
+        ESP_LOGW(TAG, "SSID blob CRC mismatch");
+        return false;
+    }
+
+    SsidList list;
+    list.reserve(header.count);
+    for (int i = 0; i < header.count; i++) {
+        if (p >= end || *p > MAX_SSID_LENGTH || end - p < 1 + *p + 1) {
+            return false;
+        }
+        SsidItem item;
+        item.ssid.assign(std::string_view((const char*)p + 1, *p));
+        p += 1 + *p;
+        if (*p > MAX_PASSWORD_LENGTH || end - p < 1 + *p) {
+            return false;
+        }
+        item.password.assign(std::string_view((const char*)p + 1, *p));
+        p += 1 + *p;
+        list.push_back(item);
+    }
+    if (p != end) {
+        return false;
+    }
+    out = std::move(list);
+    return true;
 }
 
 void SsidManager::LoadFromNvs() {
-    ssid_list_.clear();
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    saved_blob_.clear();
 
-    // Load ssid and password from NVS from namespace "wifi"
-    // ssid, ssid1, ssid2, ... ssid9
-    // password, password1, password2, ... password9
     nvs_handle_t nvs_handle;
     auto ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
     if (ret != ESP_OK) {
@@ -33,7 +124,44 @@ void SsidManager::LoadFromNvs() {
         ESP_LOGW(TAG, "NVS namespace %s doesn't exist", NVS_NAMESPACE);
         return;
     }
-    for (int i = 0; i < MAX_WIFI_SSID_COUNT; i++) {
+
+    // Single read into a buffer large enough for a full list
+    std::vector<uint8_t> blob(kMaxBlobSize);
+    size_t length = blob.size();
+    ret = nvs_get_blob(nvs_handle, NVS_BLOB_KEY, blob.data(), &length);
+    nvs_close(nvs_handle);
+
+    SsidList list;
+    if (ret == ESP_OK) {
+        blob.resize(length);
+        if (Deserialize(blob.data(), blob.size(), list)) {
+            ESP_LOGI(TAG, "Loaded %d saved networks", (int)list.size());
+            saved_blob_ = std::move(blob);
+            Publish(std::move(list));
+            return;
+        }
+        ESP_LOGE(TAG, "Saved network list is corrupted, discarding it");
+        return;
+    }
+
+    if (ret == ESP_ERR_NVS_NOT_FOUND && LoadLegacyKeys(list)) {
+        ESP_LOGI(TAG, "Migrating %d saved networks to the blob format", (int)list.size());
+        SaveToNvs(list);
+        if (!saved_blob_.empty()) {
+            EraseLegacyKeys();
+        }
+        Publish(std::move(list));
+    }
+}
+
+// Lists written by older firmware: ssid, ssid1..ssid9 / password, password1..password9
+bool SsidManager::LoadLegacyKeys(SsidList& list) {
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return false;
+    }
+    bool found = false;
+    for (int i = 0; i < LEGACY_SSID_COUNT; i++) {
         std::string ssid_key = "ssid";
         if (i > 0) {
             ssid_key += std::to_string(i);
@@ -42,84 +170,107 @@ void SsidManager::LoadFromNvs() {
         if (i > 0) {
             password_key += std::to_string(i);
         }
-        
+
         char ssid[33];
         char password[65];
         size_t length = sizeof(ssid);
         if (nvs_get_str(nvs_handle, ssid_key.c_str(), ssid, &length) != ESP_OK) {
             continue;
         }
+        found = true;
         length = sizeof(password);
         if (nvs_get_str(nvs_handle, password_key.c_str(), password, &length) != ESP_OK) {
             continue;
         }
-        ssid_list_.push_back({ssid, password});
+        list.push_back({SsidString(ssid), PasswordString(password)});
     }
     nvs_close(nvs_handle);
+    return found;
 }
 
-void SsidManager::SaveToNvs() {
+void SsidManager::EraseLegacyKeys() {
     nvs_handle_t nvs_handle;
-    ESP_ERROR_CHECK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle));
-    for (int i = 0; i < MAX_WIFI_SSID_COUNT; i++) {
-        std::string ssid_key = "ssid";
-        if (i > 0) {
-            ssid_key += std::to_string(i);
-        }
-        std::string password_key = "password";
-        if (i > 0) {
-            password_key += std::to_string(i);
-        }
-        
-        if (i < ssid_list_.size()) {
-            nvs_set_str(nvs_handle, ssid_key.c_str(), ssid_list_[i].ssid.c_str());
-            nvs_set_str(nvs_handle, password_key.c_str(), ssid_list_[i].password.c_str());
-        } else {
-            nvs_erase_key(nvs_handle, ssid_key.c_str());
-            nvs_erase_key(nvs_handle, password_key.c_str());
-        }
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    for (int i = 0; i < LEGACY_SSID_COUNT; i++) {
+        std::string suffix = i > 0 ? std::to_string(i) : "";
+        nvs_erase_key(nvs_handle, ("ssid" + suffix).c_str());
+        nvs_erase_key(nvs_handle, ("password" + suffix).c_str());
     }
     nvs_commit(nvs_handle);
     nvs_close(nvs_handle);
 }
 
-void SsidManager::AddSsid(const std::string& ssid, const std::string& password) {
-    for (auto& item : ssid_list_) {
-        ESP_LOGI(TAG, "compare [%s:%d] [%s:%d]", item.ssid.c_str(), item.ssid.size(), ssid.c_str(), ssid.size());
+void SsidManager::SaveToNvs(const SsidList& list) {
+    auto blob = Serialize(list);
+    if (blob == saved_blob_) {
+        ESP_LOGD(TAG, "Network list unchanged, skip NVS write");
+        return;
+    }
+
+    nvs_handle_t nvs_handle;
+    ESP_ERROR_CHECK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle));
+    esp_err_t err = nvs_set_blob(nvs_handle, NVS_BLOB_KEY, blob.data(), blob.size());
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save network list: %s", esp_err_to_name(err));
+        return;
+    }
+    saved_blob_ = std::move(blob);
+}
+
+void SsidManager::AddSsid(std::string_view ssid, std::string_view password) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    SsidList list = *GetSsidList();
+    for (auto& item : list) {
+        ESP_LOGI(TAG, "compare [%s:%d] [%.*s:%d]", item.ssid.c_str(), item.ssid.size(), (int)ssid.size(), ssid.data(), ssid.size());
         if (item.ssid == ssid) {
-            ESP_LOGW(TAG, "SSID %s already exists, overwrite it", ssid.c_str());
+            ESP_LOGW(TAG, "SSID %s already exists, overwrite it", item.ssid.c_str());
             item.password = password;
-            SaveToNvs();
+            SaveToNvs(list);
+            Publish(std::move(list));
             return;
         }
     }
 
-    if (ssid_list_.size() >= MAX_WIFI_SSID_COUNT) {
+    if (list.size() >= MAX_WIFI_SSID_COUNT) {
         ESP_LOGW(TAG, "SSID list is full, pop one");
-        ssid_list_.pop_back();
+        list.pop_back();
     }
     // Add the new ssid to the front of the list
-    ssid_list_.insert(ssid_list_.begin(), {ssid, password});
-    SaveToNvs();
+    list.insert(list.begin(), {SsidString(ssid), PasswordString(password)});
+    SaveToNvs(list);
+    Publish(std::move(list));
 }
 
 void SsidManager::RemoveSsid(int index) {
-    if (index < 0 || index >= ssid_list_.size()) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    SsidList list = *GetSsidList();
+    if (index < 0 || index >= list.size()) {
         ESP_LOGW(TAG, "Invalid index %d", index);
         return;
     }
-    ssid_list_.erase(ssid_list_.begin() + index);
-    SaveToNvs();
+    list.erase(list.begin() + index);
+    SaveToNvs(list);
+    Publish(std::move(list));
 }
 
 void SsidManager::SetDefaultSsid(int index) {
-    if (index < 0 || index >= ssid_list_.size()) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    SsidList list = *GetSsidList();
+    if (index < 0 || index >= list.size()) {
         ESP_LOGW(TAG, "Invalid index %d", index);
         return;
     }
     // Move the ssid at index to the front of the list
-    auto item = ssid_list_[index];
-    ssid_list_.erase(ssid_list_.begin() + index);
-    ssid_list_.insert(ssid_list_.begin(), item);
-    SaveToNvs();
+    auto item = list[index];
+    list.erase(list.begin() + index);
+    list.insert(list.begin(), item);
+    SaveToNvs(list);
+    Publish(std::move(list));
 }
@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""Build the config portal assets into a C++ header or an asset bundle.
+
+Each input file is minified, gzip-compressed and emitted as a byte array plus
+an entry of kPortalAssets with its URI, content type, compressed length and a
+strong ETag derived from the content. The output is byte-for-byte
+reproducible (no timestamps), so unchanged assets keep their ETag across
+firmware builds.
+
+With --bundle the same assets are packed into a binary for the `storage`
+partition instead (layout in khoa_ota_update/include/asset_bundle.h). The
+portal serves a bundle over its embedded copy when the bundle's --version is
+higher than the one the firmware was built with, so web UI fixes can ship as
+an asset-only OTA.
+
+Usage: gen_portal_assets.py --output portal_assets.h [--version N] URI=FILE [URI=FILE ...]
+       gen_portal_assets.py --bundle assets.bin --version N URI=FILE [URI=FILE ...]
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import struct
+import sys
+import zlib
+
+CONTENT_TYPES = {
+    '.html': 'text/html; charset=utf-8',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.svg': 'image/svg+xml',
+}
+
+BLOCK_COMMENT = re.compile(r'/\*.*?\*/', re.S)
+HTML_COMMENT = re.compile(r'<!--(?!\[if).*?-->', re.S)
+LINE_COMMENT = re.compile(r'^\s*//.*$', re.M)
+SECTION = re.compile(r'(<(script|style)\b[^>]*>)(.*?)(</\2>)', re.S | re.I)
+
+# Must match AssetBundleHeader / AssetBundleEntry (little endian)
+BUNDLE_MAGIC = 0x4241504B  # "KPAB"
+BUNDLE_FORMAT = 1
+BUNDLE_HEADER = struct.Struct('<IHHIII')     # magic, format, count, version, length, crc32
+BUNDLE_ENTRY = struct.Struct('<32s32s20sII')  # uri, content_type, etag, offset, length
+
+
+def minify_code(code):
+    # Whole-line comments and /* */ blocks only: stripping trailing // comments
+    # would need a tokenizer to stay clear of URLs inside strings
+    code = BLOCK_COMMENT.sub('', code)
+    code = LINE_COMMENT.sub('', code)
+    return code
+
+
+def minify_html(text):
+    text = HTML_COMMENT.sub('', text)
+    text = SECTION.sub(lambda m: m.group(1) + minify_code(m.group(3)) + m.group(4), text)
+    # Newlines are kept so JavaScript automatic semicolon insertion still works
+    lines = (line.strip() for line in text.splitlines())
+    return '\n'.join(line for line in lines if line) + '\n'
+
+
+def minify(path, data):
+    ext = os.path.splitext(path)[1].lower()
+    text = data.decode('utf-8')
+    if ext == '.html':
+        return minify_html(text).encode('utf-8')
+    if ext in ('.css', '.js'):
+        lines = (line.strip() for line in minify_code(text).splitlines())
+        return ('\n'.join(line for line in lines if line) + '\n').encode('utf-8')
+    return data
+
+
+def symbol_for(uri):
+    name = re.sub(r'[^0-9A-Za-z]', '_', uri.strip('/')) or 'index'
+    return 'kPortalAsset_' + name
+
+
+def format_bytes(data):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append('    ' + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',')
+    return '\n'.join(rows)
+
+
+def load_assets(specs):
+    assets = []
+    for spec in specs:
+        uri, path = spec.split('=', 1)
+        with open(path, 'rb') as f:
+            raw = f.read()
+        minified = minify(path, raw)
+        compressed = gzip.compress(minified, compresslevel=9, mtime=0)
+        assets.append({
+            'uri': uri,
+            'path': path,
+            'raw': raw,
+            'minified': minified,
+            'compressed': compressed,
+            'etag': '"%s"' % hashlib.sha256(compressed).hexdigest()[:16],
+            'content_type': CONTENT_TYPES.get(os.path.splitext(path)[1].lower(), 'application/octet-stream'),
+        })
+    return assets
+
+
+def fixed_field(text, size, what):
+    data = text.encode('utf-8')
+    if len(data) >= size:
+        sys.exit('%s too long for the bundle (max %d bytes): %s' % (what, size - 1, text))
+    return data
+
+
+def write_bundle(path, assets, version):
+    # Entries first, then the gzip data; offsets are from the start of the bundle
+    offset = BUNDLE_HEADER.size + BUNDLE_ENTRY.size * len(assets)
+    entries = b''
+    data = b''
+    for asset in assets:
+        entries += BUNDLE_ENTRY.pack(fixed_field(asset['uri'], 32, 'URI'),
+                                     fixed_field(asset['content_type'], 32, 'Content type'),
+                                     fixed_field(asset['etag'], 20, 'ETag'),
+                                     offset + len(data), len(asset['compressed']))
+        data += asset['compressed']
+        data += b'\0' * (-len(data) % 4)
+    body = entries + data
+    header = BUNDLE_HEADER.pack(BUNDLE_MAGIC, BUNDLE_FORMAT, len(assets), version,
+                                len(body), zlib.crc32(body))
+    with open(path, 'wb') as f:
+        f.write(header + body)
+    print('Portal asset bundle v%d: %d assets, %d bytes' % (version, len(assets), len(header) + len(body)))
+
+
+def write_header(path, assets, version):
+    arrays = []
+    entries = []
+    total_raw = total_gz = 0
+    for asset in assets:
+        uri = asset['uri']
+        raw, minified, compressed = asset['raw'], asset['minified'], asset['compressed']
+        etag, content_type = asset['etag'], asset['content_type']
+        symbol = symbol_for(uri)
+        total_raw += len(raw)
+        total_gz += len(compressed)
+
+        arrays.append('// %s: %d bytes, %d minified, %d gzip\nstatic const uint8_t %s[] = {\n%s\n};\n'
+                      % (os.path.basename(asset['path']), len(raw), len(minified), len(compressed),
+                         symbol, format_bytes(compressed)))
+        entries.append('    {"%s", "%s", %s, sizeof(%s), "%s"},'
+                       % (uri, content_type, symbol, symbol, etag.replace('"', '\\"')))
+
+    header = [
+        '// Generated by gen_portal_assets.py, do not edit',
+        '#pragma once',
+        '',
+        '#include <cstddef>',
+        '#include <cstdint>',
+        '',
+        'struct PortalAsset {',
+        '    const char* uri;',
+        '    const char* content_type;',
+        '    const uint8_t* data;     // gzip',
+        '    size_t length;',
+        '    const char* etag;',
+        '};',
+        '',
+    ]
+    header += arrays
+    header += [
+        '// A bundle in the storage partition is served instead when its version is higher',
+        'static constexpr uint32_t kPortalAssetsVersion = %d;' % version,
+        '',
+        'static constexpr PortalAsset kPortalAssets[] = {',
+        *entries,
+        '};',
+        '',
+    ]
+
+    content = '\n'.join(header)
+    # Leave the file untouched when nothing changed to avoid needless rebuilds
+    if os.path.exists(path):
+        with open(path, 'r') as f:
+            if f.read() == content:
+                return
+    with open(path, 'w') as f:
+        f.write(content)
+    print('Portal assets: %d bytes -> %d bytes gzip' % (total_raw, total_gz))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--output', help='C++ header to generate')
+    parser.add_argument('--bundle', help='Asset bundle for the storage partition')
+    parser.add_argument('--version', type=int, default=0, help='Asset version (bundles need one above 0)')
+    parser.add_argument('assets', nargs='+', metavar='URI=FILE')
+    args = parser.parse_args()
+    if not args.output and not args.bundle:
+        parser.error('one of --output or --bundle is required')
+    if args.bundle and not 0 < args.version < 2 ** 32:
+        parser.error('--bundle needs a --version between 1 and 2^32-1')
+
+    assets = load_assets(args.assets)
+    if args.output:
+        write_header(args.output, assets, args.version)
+    if args.bundle:
+        write_bundle(args.bundle, assets, args.version)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
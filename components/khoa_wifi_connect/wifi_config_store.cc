@@ -0,0 +1,181 @@
+#include "wifi_config_store.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <esp_log.h>
+#include <nvs_flash.h>
+
+#define TAG "WifiConfigStore"
+#define NVS_NAMESPACE "wifi"
+
+template <size_t N>
+static void nvs_load_string(nvs_handle_t nvs, const char* key, FixedString<N>& out) {
+    char value[N + 1];
+    size_t length = sizeof(value);
+    esp_err_t err = nvs_get_str(nvs, key, value, &length);
+    if (err == ESP_OK) {
+        out = value;
+    } else if (err == ESP_ERR_NVS_INVALID_LENGTH) {
+        ESP_LOGW(TAG, "\"%s\" is longer than %d bytes, ignored", key, (int)N);
+    }
+}
+
+void WifiConfigStore::Load() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LoadLocked();
+}
+
+void WifiConfigStore::LoadLocked() {
+    WifiAdvancedConfig config;
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_load_string(nvs, "ota_url", config.ota_url);
+        nvs_load_string(nvs, "gs_url", config.google_sheet_url);
+        nvs_load_string(nvs, "gs_url_2", config.google_sheet_url_2);
+        nvs_load_string(nvs, "vibo_key", config.vibo_key);
+        nvs_get_i8(nvs, "max_tx_power", &config.max_tx_power);
+        uint8_t value;
+        if (nvs_get_u8(nvs, "remember_bssid", &value) == ESP_OK) {
+            config.remember_bssid = value != 0;
+        }
+        if (nvs_get_u8(nvs, "sleep_mode", &value) == ESP_OK) {
+            config.sleep_mode = value != 0;
+        }
+        nvs_close(nvs);
+    }
+    config_ = std::move(config);
+    loaded_ = true;
+}
+
+void WifiConfigStore::EnsureLoadedLocked() {
+    if (!loaded_) {
+        LoadLocked();
+    }
+}
+
+WifiAdvancedConfig WifiConfigStore::Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureLoadedLocked();
+    return config_;
+}
+
+UrlString WifiConfigStore::GetOtaUrl() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureLoadedLocked();
+    return config_.ota_url;
+}
+
+UrlString WifiConfigStore::GetGoogleSheetUrl1() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureLoadedLocked();
+    return config_.google_sheet_url;
+}
+
+UrlString WifiConfigStore::GetGoogleSheetUrl2() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureLoadedLocked();
+    return config_.google_sheet_url_2;
+}
+
+FixedString<15> WifiConfigStore::GetViboKey() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureLoadedLocked();
+    return config_.vibo_key;
+}
+
+int8_t WifiConfigStore::GetMaxTxPower() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureLoadedLocked();
+    return config_.max_tx_power;
+}
+
+bool WifiConfigStore::GetRememberBssid() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureLoadedLocked();
+    return config_.remember_bssid;
+}
+
+bool WifiConfigStore::GetSleepMode() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnsureLoadedLocked();
+    return config_.sleep_mode;
+}
+
+esp_err_t WifiConfigStore::SaveLocked(const WifiAdvancedConfig& old_config, const WifiAdvancedConfig& new_config) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    auto save_str = [&](const char* key, const auto& old_value, const auto& new_value) {
+        if (err == ESP_OK && old_value != new_value) {
+            err = nvs_set_str(nvs, key, new_value.c_str());
+        }
+    };
+    save_str("ota_url", old_config.ota_url, new_config.ota_url);
+    save_str("gs_url", old_config.google_sheet_url, new_config.google_sheet_url);
+    save_str("gs_url_2", old_config.google_sheet_url_2, new_config.google_sheet_url_2);
+    save_str("vibo_key", old_config.vibo_key, new_config.vibo_key);
+    if (err == ESP_OK && old_config.max_tx_power != new_config.max_tx_power) {
+        err = nvs_set_i8(nvs, "max_tx_power", new_config.max_tx_power);
+    }
+    if (err == ESP_OK && old_config.remember_bssid != new_config.remember_bssid) {
+        err = nvs_set_u8(nvs, "remember_bssid", new_config.remember_bssid ? 1 : 0);
+    }
+    if (err == ESP_OK && old_config.sleep_mode != new_config.sleep_mode) {
+        err = nvs_set_u8(nvs, "sleep_mode", new_config.sleep_mode ? 1 : 0);
+    }
+
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+esp_err_t WifiConfigStore::Update(const std::function<void(WifiAdvancedConfig& config)>& mutate) {
+    // Both copies on the heap (~850 bytes each): callers include 4 KB httpd workers,
+    // and SaveLocked() goes deep into NVS on the same stack
+    std::unique_ptr<WifiAdvancedConfig> old_config(new (std::nothrow) WifiAdvancedConfig());
+    std::unique_ptr<WifiAdvancedConfig> new_config(new (std::nothrow) WifiAdvancedConfig());
+    if (!old_config || !new_config) {
+        return ESP_ERR_NO_MEM;
+    }
+    std::vector<Subscriber> subscribers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        EnsureLoadedLocked();
+        *old_config = config_;
+        *new_config = config_;
+        mutate(*new_config);
+
+        esp_err_t err = SaveLocked(*old_config, *new_config);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to save configuration: %s", esp_err_to_name(err));
+            return err;
+        }
+        config_ = *new_config;
+        subscribers = subscribers_;
+    }
+
+    for (const auto& subscriber : subscribers) {
+        subscriber.handler(*old_config, *new_config);
+    }
+    return ESP_OK;
+}
+
+int WifiConfigStore::Subscribe(ChangeHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int id = next_subscriber_id_++;
+    subscribers_.push_back({id, std::move(handler)});
+    return id;
+}
+
+void WifiConfigStore::Unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(), [id](const Subscriber& s) {
+        return s.id == id;
+    }), subscribers_.end());
+}
@@ -1,8 +1,14 @@
 #include "wifi_configuration_ap.h"
 #include <cstdio>
 #include <memory>
+#include <new>
+#include <array>
+#include <algorithm>
+#include <iterator>
+#include <utility>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 #include <esp_err.h>
 #include <esp_event.h>
 #include <esp_wifi.h>
@@ -10,43 +16,101 @@
 #include <esp_mac.h>
 #include <esp_netif.h>
 #include <lwip/ip_addr.h>
-#include <nvs.h>
-#include <nvs_flash.h>
-#include <cJSON.h>
 #if !CONFIG_IDF_TARGET_ESP32P4
 #include <esp_smartconfig.h>
 #endif
 #include "ssid_manager.h"
+#include "wifi_config_store.h"
+#include "wifi_scan_service.h"
+#include "portal_router.h"
+#include "json_stream.h"
+#include "ota_manager.h"
+#include "asset_bundle.h"
 #include "sdkconfig.h"
 
 #define TAG "WifiConfigurationAp"
 
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT      BIT1
+#define WIFI_DISCONNECTED_BIT BIT2
 
-extern const char index_html_start[] asm("_binary_wifi_configuration_html_start");
-extern const char done_html_start[] asm("_binary_wifi_configuration_done_html_start");
+static constexpr int8_t kDefaultMaxTxPower = 80;  // 20 dBm, used while "max_tx_power" is unset
+
+// Generated at build time by tools/gen_portal_assets.py: minified, gzipped pages with ETags
+#include "portal_assets.h"
+
+// Pages are only sent gzip-compressed; every browser a captive portal can open accepts it.
+// no-cache still lets the browser keep a copy but revalidate it, so a firmware update
+// with new pages (new ETag) is picked up at once while an unchanged page costs a 304.
+static esp_err_t ServePortalAsset(httpd_req_t *req, const PortalAsset& asset)
+{
+    httpd_resp_set_hdr(req, "ETag", asset.etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char if_none_match[48];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, asset.etag) != nullptr) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    httpd_resp_set_type(req, asset.content_type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    return httpd_resp_send(req, reinterpret_cast<const char*>(asset.data), asset.length);
+}
+
+// JsonWriter sink for chunked responses
+static bool SendChunk(void *ctx, const char *data, size_t length)
+{
+    return httpd_resp_send_chunk(static_cast<httpd_req_t *>(ctx), data, length) == ESP_OK;
+}
+
+// Read the whole request body into `buf`. On failure the error response has
+// already been sent.
+static bool ReceiveBody(httpd_req_t *req, char *buf, size_t size, std::string_view &body)
+{
+    if (req->content_len > size) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Payload too large");
+        return false;
+    }
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_408(req);
+            } else {
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive request");
+            }
+            return false;
+        }
+        received += ret;
+    }
+    body = std::string_view(buf, received);
+    return true;
+}
 
 WifiConfigurationAp::WifiConfigurationAp()
 {
     event_group_ = xEventGroupCreate();
     language_ = "zh-CN";
-    sleep_mode_ = false;
     instance_any_id_ = nullptr;
     instance_got_ip_ = nullptr;
-    max_tx_power_ = 0;
-    remember_bssid_ = false;
 }
 
 std::vector<wifi_ap_record_t> WifiConfigurationAp::GetAccessPoints()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return ap_records_;
+    auto results = WifiScanService::GetInstance().GetResults();
+    return results ? results->records : std::vector<wifi_ap_record_t>();
 }   
 
 WifiConfigurationAp::~WifiConfigurationAp()
 {
-    Stop();
+    // The driver belongs to WifiManager: a portal still running here is torn
+    // down without stopping it (after Stop() this is a no-op)
+    Stop(true);
+    ReleaseInterface();
     if (event_group_) {
         vEventGroupDelete(event_group_);
         event_group_ = nullptr;
@@ -73,42 +137,200 @@ void WifiConfigurationAp::SetSsidPrefix(const std::string &ssid_prefix)
     ssid_prefix_ = ssid_prefix;
 }
 
-void WifiConfigurationAp::Start()
+void WifiConfigurationAp::Start(bool driver_running)
 {
-    // Register event handlers
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &WifiConfigurationAp::WifiEventHandler,
-                                                        this,
-                                                        &instance_any_id_));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &WifiConfigurationAp::IpEventHandler,
-                                                        this,
-                                                        &instance_got_ip_));
+    // Register event handlers, kept from the last session in warm mode
+    if (instance_any_id_ == nullptr) {
+        ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                            ESP_EVENT_ANY_ID,
+                                                            &WifiConfigurationAp::WifiEventHandler,
+                                                            this,
+                                                            &instance_any_id_));
+        ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                            IP_EVENT_STA_GOT_IP,
+                                                            &WifiConfigurationAp::IpEventHandler,
+                                                            this,
+                                                            &instance_got_ip_));
+    }
+    active_ = true;
 
-    StartAccessPoint();
+    StartAccessPoint(driver_running);
     StartWebServer();
     
-    // Start scan immediately
-    esp_wifi_scan_start(nullptr, false);
-    // Setup periodic WiFi scan timer
-    esp_timer_create_args_t timer_args = {
-        .callback = [](void* arg) {
-            auto* self = static_cast<WifiConfigurationAp*>(arg);
-            if (!self->is_connecting_) {
-                esp_wifi_scan_start(nullptr, false);
-            }
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "wifi_scan_timer",
-        .skip_unhandled_events = true
+    // Scan once so the first page load has a list (the channel survey's scan
+    // does); after that only pages that are open trigger scans (see RefreshScan())
+    RefreshScan(WifiScanService::GetInstance().GetResults());
+}
+
+// Rescan only when the cached results are stale, so an idle portal keeps the
+// radio on the AP channel
+void WifiConfigurationAp::RefreshScan(const WifiScanService::Snapshot& results)
+{
+    if (is_connecting_ || uploading_) {
+        return;
+    }
+    if (!results || results->AgeMs() > kScanMaxAgeMs) {
+        WifiScanService::GetInstance().RequestScan();
+    }
+}
+
+// httpd task only, like everything else that touches the scan feed
+void WifiConfigurationAp::SyncScanFeed()
+{
+    auto results = WifiScanService::GetInstance().GetResults();
+    if (!results || results == scan_feed_source_) {
+        return;
+    }
+    scan_feed_source_ = results;
+    std::string delta;
+    if (scan_feed_.Update(*results, delta)) {
+        PushScanEvent("delta", delta);
+    }
+}
+
+// Detach `req` as a Server-Sent Events stream: the response stays open and
+// later events go out as chunks of it. Null when refused (the reply is sent).
+static httpd_req_t *BeginEventStream(httpd_req_t *req, size_t open, size_t limit)
+{
+    if (open >= limit) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, nullptr, 0);
+        return nullptr;
+    }
+    httpd_req_t *stream = nullptr;
+    if (httpd_req_async_handler_begin(req, &stream) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return nullptr;
+    }
+    httpd_resp_set_type(stream, "text/event-stream");
+    httpd_resp_set_hdr(stream, "Cache-Control", "no-store");
+    return stream;
+}
+
+// A failed write means the page is gone: its stream is released
+static void SendEvent(std::vector<httpd_req_t*>& streams, const char* event, std::string_view data)
+{
+    std::string frame = "event: ";
+    frame += event;
+    frame += "\ndata: ";
+    frame += data;
+    frame += "\n\n";
+    for (auto it = streams.begin(); it != streams.end();) {
+        if (httpd_resp_send_chunk(*it, frame.data(), frame.size()) == ESP_OK) {
+            ++it;
+            continue;
+        }
+        httpd_req_async_handler_complete(*it);
+        it = streams.erase(it);
+        ESP_LOGI(TAG, "Event stream closed (%d open)", (int)streams.size());
+    }
+}
+
+// Scan streams are kept in scan_streams_ (the page falls back to polling /scan
+// when refused)
+esp_err_t WifiConfigurationAp::OpenScanStream(httpd_req_t *req)
+{
+    httpd_req_t *stream = BeginEventStream(req, scan_streams_.size(), kMaxScanStreams);
+    if (stream == nullptr) {
+        return ESP_OK;
+    }
+
+    RefreshScan(WifiScanService::GetInstance().GetResults());
+    SyncScanFeed();
+    std::string frame = "retry: 3000\nevent: scan\ndata: ";
+    frame += *scan_feed_.GetJson();
+    frame += "\n\n";
+    if (httpd_resp_send_chunk(stream, frame.data(), frame.size()) != ESP_OK) {
+        httpd_req_async_handler_complete(stream);
+        return ESP_FAIL;
+    }
+    scan_streams_.push_back(stream);
+    if (!esp_timer_is_active(scan_timer_)) {
+        esp_timer_start_periodic(scan_timer_, kScanMaxAgeMs * 1000);
+    }
+    ESP_LOGI(TAG, "Scan stream opened (%d open)", (int)scan_streams_.size());
+    return ESP_OK;
+}
+
+void WifiConfigurationAp::PushScanEvent(const char* event, const std::string& data)
+{
+    SendEvent(scan_streams_, event, data);
+    if (scan_streams_.empty()) {
+        esp_timer_stop(scan_timer_);
+    }
+}
+
+// httpd task: the latest upload status to the /ota/events streams
+void WifiConfigurationAp::PushUploadEvent()
+{
+    if (upload_streams_.empty()) {
+        return;
+    }
+    UploadStatus status;
+    {
+        std::lock_guard<std::mutex> lock(upload_mutex_);
+        status = upload_;
+    }
+    static constexpr const char *kStates[] = {"idle", "receiving", "verifying", "success", "failed"};
+    char buf[160];
+    JsonWriter json(buf, sizeof(buf));
+    json.BeginObject()
+        .Key("state").String(kStates[static_cast<int>(status.state)])
+        .Key("received").Int(status.received)
+        .Key("total").Int(status.total);
+    if (status.error != nullptr) {
+        json.Key("error").String(status.error);
+    }
+    json.EndObject();
+    if (json.Finish()) {
+        SendEvent(upload_streams_, "progress", json.View());
+    }
+}
+
+// Any task: record the status and have the httpd task push it
+void WifiConfigurationAp::SetUploadStatus(const UploadStatus& status)
+{
+    {
+        std::lock_guard<std::mutex> lock(upload_mutex_);
+        upload_ = status;
+    }
+    httpd_queue_work(server_, [](void *arg) {
+        static_cast<WifiConfigurationAp *>(arg)->PushUploadEvent();
+    }, this);
+}
+
+// The streams belong to the httpd task: have it end them and wait
+void WifiConfigurationAp::CloseEventStreams()
+{
+    if (server_ == nullptr) {
+        return;
+    }
+    struct CloseRequest {
+        WifiConfigurationAp* self;
+        SemaphoreHandle_t done;
     };
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &scan_timer_));
+    CloseRequest request = {this, xSemaphoreCreateBinary()};
+    if (request.done == nullptr) {
+        return;
+    }
+    esp_err_t err = httpd_queue_work(server_, [](void *arg) {
+        auto* request = static_cast<CloseRequest*>(arg);
+        for (auto* streams : {&request->self->scan_streams_, &request->self->upload_streams_}) {
+            for (auto* stream : *streams) {
+                httpd_resp_send_chunk(stream, nullptr, 0);
+                httpd_req_async_handler_complete(stream);
+            }
+            streams->clear();
+        }
+        xSemaphoreGive(request->done);
+    }, &request);
+    if (err == ESP_OK) {
+        xSemaphoreTake(request.done, portMAX_DELAY);
+    }
+    vSemaphoreDelete(request.done);
 }
 
-std::string WifiConfigurationAp::GetSsid()
+SsidString WifiConfigurationAp::GetSsid()
 {
     // Get MAC and use it to generate a unique SSID
     uint8_t mac[6];
@@ -117,9 +339,9 @@ std::string WifiConfigurationAp::GetSsid()
 #else
     ESP_ERROR_CHECK(esp_read_mac(mac, ESP_MAC_WIFI_SOFTAP));
 #endif
-    char ssid[32];
+    char ssid[SsidString::kCapacity + 1];
     snprintf(ssid, sizeof(ssid), "%s-%02X%02X", ssid_prefix_.c_str(), mac[4], mac[5]);
-    return std::string(ssid);
+    return SsidString(ssid);
 }
 
 std::string WifiConfigurationAp::GetWebServerUrl()
@@ -128,42 +350,100 @@ std::string WifiConfigurationAp::GetWebServerUrl()
     return "http://192.168.4.1";
 }
 
-void WifiConfigurationAp::StartAccessPoint()
+// Scan once and pick the 2.4 GHz channel (within the country's range) with the
+// lowest ApSelector::ChannelLoad; channel_ keeps 0, the driver's default, when
+// the scan fails. The scan also serves as the portal's first AP list.
+void WifiConfigurationAp::SurveyChannel()
+{
+    struct Survey {
+        SemaphoreHandle_t done = xSemaphoreCreateBinary();
+        WifiScanService::Snapshot results;
+        ~Survey() { if (done) vSemaphoreDelete(done); }
+    };
+    // Shared with the scan callback, which may still run after a timeout here
+    auto survey = std::make_shared<Survey>();
+    bool requested = survey->done != nullptr &&
+        WifiScanService::GetInstance().RequestScan([survey](const WifiScanService::Snapshot& results) {
+            survey->results = results;
+            xSemaphoreGive(survey->done);
+        });
+    if (!requested || xSemaphoreTake(survey->done, pdMS_TO_TICKS(kSurveyTimeoutMs)) != pdTRUE || !survey->results) {
+        ESP_LOGW(TAG, "Channel survey failed, using the default channel");
+        return;
+    }
+
+    wifi_country_t country = {};
+    uint8_t first = 1;
+    uint8_t last = 11;
+    if (esp_wifi_get_country(&country) == ESP_OK && country.nchan > 0) {
+        first = country.schan;
+        last = std::min<int>(country.schan + country.nchan - 1, 13);
+    }
+    const auto& records = survey->results->records;
+    channel_ = ApSelector::QuietestChannel(records.data(), records.size(), first, last);
+
+    char loads[128];
+    int length = 0;
+    for (uint8_t channel = first; channel <= last && length < (int)sizeof(loads); channel++) {
+        length += snprintf(loads + length, sizeof(loads) - length, " %d:%d", channel,
+                           ApSelector::ChannelLoad(channel, records.data(), records.size()));
+    }
+    ESP_LOGI(TAG, "Channel survey of %d APs, load per channel:%s -> channel %d (load %d)",
+             (int)records.size(), loads, channel_.channel, channel_.load);
+}
+
+void WifiConfigurationAp::StartAccessPoint(bool driver_running)
 {
     // Note: esp_netif_init() and esp_wifi_init() should be called once before calling this method
     // WiFi driver is initialized by WifiManager::Initialize() and kept alive
     
-    // Create the default WiFi AP interface
-    ap_netif_ = esp_netif_create_default_wifi_ap();
-
-    // Set the router IP address to 192.168.4.1
-    esp_netif_ip_info_t ip_info;
-    IP4_ADDR(&ip_info.ip, 192, 168, 4, 1);
-    IP4_ADDR(&ip_info.gw, 192, 168, 4, 1);
-    IP4_ADDR(&ip_info.netmask, 255, 255, 255, 0);
-    esp_netif_dhcps_stop(ap_netif_);
-    esp_netif_set_ip_info(ap_netif_, &ip_info);
-    esp_netif_dhcps_start(ap_netif_);
+    // Create the default WiFi AP interface unless WifiManager lent a persistent one
+    if (ap_netif_ == nullptr) {
+        ap_netif_ = CreateNetif();
+        owns_netif_ = true;
+    }
 
     // Start the DNS server
     dns_server_ = std::make_unique<DnsServer>();
+    esp_netif_ip_info_t ip_info;
+    esp_netif_get_ip_info(ap_netif_, &ip_info);
     dns_server_->Start(ip_info.gw);
 
     // Get the SSID
-    std::string ssid = GetSsid();
+    SsidString ssid = GetSsid();
 
     // Set the WiFi configuration
     wifi_config_t wifi_config = {};
-    strcpy((char *)wifi_config.ap.ssid, ssid.c_str());
+    memcpy(wifi_config.ap.ssid, ssid.data(), ssid.size());
     wifi_config.ap.ssid_len = ssid.length();
     wifi_config.ap.max_connection = 4;
     wifi_config.ap.authmode = WIFI_AUTH_OPEN;
+    // With the station still associated the AP has to share its channel;
+    // otherwise survey first, in STA mode so no client joins a channel the AP
+    // is about to leave
+    channel_ = ApChannelChoice();
+    wifi_ap_record_t uplink;
+    if (esp_wifi_sta_get_ap_info(&uplink) == ESP_OK) {
+        channel_.channel = uplink.primary;
+        channel_.shared = true;
+        ESP_LOGI(TAG, "Sharing channel %d with the station uplink", uplink.primary);
+    } else if (channel_survey_) {
+        if (!driver_running) {
+            ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+            ESP_ERROR_CHECK(esp_wifi_start());
+            driver_running = true;
+        }
+        SurveyChannel();
+    }
+    wifi_config.ap.channel = channel_.channel;
 
     // Start the WiFi Access Point
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
-    ESP_ERROR_CHECK(esp_wifi_start());
+    if (!driver_running) {
+        ESP_ERROR_CHECK(esp_wifi_start());
+    }
 
 #ifdef CONFIG_SOC_WIFI_SUPPORT_5G
     ESP_ERROR_CHECK(esp_wifi_set_band_mode(WIFI_BAND_MODE_AUTO));
@@ -171,74 +451,15 @@ void WifiConfigurationAp::StartAccessPoint()
     ESP_ERROR_CHECK(esp_wifi_set_band_mode(WIFI_BAND_MODE_2G_ONLY));
 #endif
 
-    ESP_LOGI(TAG, "Access Point started with SSID %s", ssid.c_str());
-
-    // 加载高级配置
-    nvs_handle_t nvs;
-    esp_err_t err = nvs_open("wifi", NVS_READONLY, &nvs);
-    if (err == ESP_OK) {
-        // 读取OTA URL
-        char ota_url[256] = {0};
-        size_t ota_url_size = sizeof(ota_url);
-        err = nvs_get_str(nvs, "ota_url", ota_url, &ota_url_size);
-        if (err == ESP_OK) {
-            ota_url_ = ota_url;
-        }
-
-        // 读取WiFi功率
-        err = nvs_get_i8(nvs, "max_tx_power", &max_tx_power_);
-        if (err == ESP_OK) {
-            ESP_LOGI(TAG, "WiFi max tx power from NVS: %d", max_tx_power_);
-            ESP_ERROR_CHECK(esp_wifi_set_max_tx_power(max_tx_power_));
-        } else {
-            // Default to 20 dBm (80 units) if not set
-            max_tx_power_ = 80;
-            esp_wifi_set_max_tx_power(max_tx_power_);
-        }
-
-        // 读取BSSID记忆设置
-        uint8_t remember_bssid = 0;
-        err = nvs_get_u8(nvs, "remember_bssid", &remember_bssid);
-        if (err == ESP_OK) {
-            remember_bssid_ = remember_bssid != 0;
-        } else {
-            remember_bssid_ = false; // 默认值
-        }
-
-        // 读取睡眠模式设置
-        uint8_t sleep_mode = 0;
-        err = nvs_get_u8(nvs, "sleep_mode", &sleep_mode);
-        if (err == ESP_OK) {
-            sleep_mode_ = sleep_mode != 0;
-        } else {
-            sleep_mode_ = true; // 默认值
-        }
-
-        // Load Google Sheet URL 1
-        char gs_url[256] = {0};
-        size_t gs_url_size = sizeof(gs_url);
-        err = nvs_get_str(nvs, "gs_url", gs_url, &gs_url_size);
-        if (err == ESP_OK) {
-            google_sheet_url_ = gs_url;
-        }
+    ESP_LOGI(TAG, "Access Point started with SSID %s on channel %d", ssid.c_str(), channel_.channel);
 
-        // Load Google Sheet URL 2
-        char gs_url_2[256] = {0};
-        size_t gs_url_2_size = sizeof(gs_url_2);
-        err = nvs_get_str(nvs, "gs_url_2", gs_url_2, &gs_url_2_size);
-        if (err == ESP_OK) {
-            google_sheet_url_2_ = gs_url_2;
-        }
-
-        // Load VIBO-KEY
-        char v_key[16] = {0};
-        size_t v_key_size = sizeof(v_key);
-        err = nvs_get_str(nvs, "vibo_key", v_key, &v_key_size);
-        if (err == ESP_OK) {
-            vibo_key_ = v_key;
-        }
-
-        nvs_close(nvs);
+    // Advanced settings live in WifiConfigStore; only the tx power needs applying here
+    int8_t max_tx_power = WifiConfigStore::GetInstance().GetMaxTxPower();
+    if (max_tx_power != 0) {
+        ESP_LOGI(TAG, "WiFi max tx power from NVS: %d", max_tx_power);
+        ESP_ERROR_CHECK(esp_wifi_set_max_tx_power(max_tx_power));
+    } else {
+        esp_wifi_set_max_tx_power(kDefaultMaxTxPower);
     }
 }
 
@@ -246,537 +467,620 @@ void WifiConfigurationAp::StartWebServer()
 {
     // Start the web server
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 24;
+    // One catch-all entry per method; Dispatch() looks the path up in kRoutes
+    config.max_uri_handlers = 2;
     config.uri_match_fn = httpd_uri_match_wildcard;
     // 5G Network takes longer to connect
     config.recv_wait_timeout = 15;
     config.send_wait_timeout = 15;
+    // Keep-alive: the page reuses its connections for the API calls; once all
+    // sockets are taken the least recently used one is closed for a new client
+    config.max_open_sockets = kMaxOpenSockets;
+    config.lru_purge_enable = true;
     ESP_ERROR_CHECK(httpd_start(&server_, &config));
 
-    // Register the index.html file
-    httpd_uri_t index_html = {
-        .uri = "/",
-        .method = HTTP_GET,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_send(req, index_html_start, strlen(index_html_start));
-            return ESP_OK;
-        },
-        .user_ctx = NULL
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &index_html));
-
-    // Register the /saved/list URI
-    httpd_uri_t saved_list = {
-        .uri = "/saved/list",
-        .method = HTTP_GET,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            auto ssid_list = SsidManager::GetInstance().GetSsidList();
-            std::string json_str = "[";
-            for (const auto& ssid : ssid_list) {
-                json_str += "\"" + ssid.ssid + "\",";
-            }
-            if (json_str.length() > 1) {
-                json_str.pop_back(); // Remove the last comma
-            }
-            json_str += "]";
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_send(req, json_str.c_str(), HTTPD_RESP_USE_STRLEN);
-            return ESP_OK;
-        },
-        .user_ctx = NULL
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &saved_list));
-
-    // Register the /saved/set_default URI
-    httpd_uri_t saved_set_default = {
-        .uri = "/saved/set_default",
-        .method = HTTP_GET,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            std::string uri = req->uri;
-            auto pos = uri.find("?index=");
-            if (pos != std::string::npos) {
-                int index = -1;
-                sscanf(&req->uri[pos+7], "%d", &index);
-                ESP_LOGI(TAG, "Set default item %d", index);
-                SsidManager::GetInstance().SetDefaultSsid(index);
-            }
-            // send {}
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_send(req, "{}", HTTPD_RESP_USE_STRLEN);
-            return ESP_OK;
-        },
-        .user_ctx = NULL
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &saved_set_default));
-
-    // Register the /saved/delete URI
-    httpd_uri_t saved_delete = {
-        .uri = "/saved/delete",
-        .method = HTTP_GET,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            std::string uri = req->uri;
-            auto pos = uri.find("?index=");
-            if (pos != std::string::npos) {
-                int index = -1;
-                sscanf(&req->uri[pos+7], "%d", &index);
-                ESP_LOGI(TAG, "Delete saved list item %d", index);
-                SsidManager::GetInstance().RemoveSsid(index);
-            }
-            // send {}
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_send(req, "{}", HTTPD_RESP_USE_STRLEN);
-            return ESP_OK;
-        },
-        .user_ctx = NULL
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &saved_delete));
-
-    // Register the /scan URI
-    httpd_uri_t scan = {
-        .uri = "/scan",
-        .method = HTTP_GET,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
-            std::lock_guard<std::mutex> lock(this_->mutex_);
-
-            // Check if 5G is supported
-            bool support_5g = false;
-#ifdef CONFIG_SOC_WIFI_SUPPORT_5G
-            support_5g = true;
-#endif
+    // Web UI fixes shipped as an asset-only OTA; the embedded pages stay the fallback
+    if (AssetBundle::GetInstance().Load() == ESP_OK &&
+        AssetBundle::GetInstance().GetVersion() > kPortalAssetsVersion) {
+        ESP_LOGI(TAG, "Serving pages from asset bundle v%" PRIu32, AssetBundle::GetInstance().GetVersion());
+    }
 
-            // Send the scan results as JSON
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_sendstr_chunk(req, "{\"support_5g\":");
-            httpd_resp_sendstr_chunk(req, support_5g ? "true" : "false");
-            httpd_resp_sendstr_chunk(req, ",\"aps\":[");
-            for (int i = 0; i < this_->ap_records_.size(); i++) {
-                ESP_LOGI(TAG, "SSID: %s, RSSI: %d, Authmode: %d",
-                    (char *)this_->ap_records_[i].ssid, this_->ap_records_[i].rssi, this_->ap_records_[i].authmode);
-                char buf[128];
-                snprintf(buf, sizeof(buf), "{\"ssid\":\"%s\",\"rssi\":%d,\"authmode\":%d}",
-                    (char *)this_->ap_records_[i].ssid, this_->ap_records_[i].rssi, this_->ap_records_[i].authmode);
-                httpd_resp_sendstr_chunk(req, buf);
-                if (i < this_->ap_records_.size() - 1) {
-                    httpd_resp_sendstr_chunk(req, ",");
-                }
+    // Handlers that write NVS or touch the driver run here, off the httpd task
+    workers_.Start(kHttpWorkers, kMaxOpenSockets, 4096, 5);
+
+    for (httpd_method_t method : {HTTP_GET, HTTP_POST}) {
+        httpd_uri_t dispatcher = {
+            .uri = "/*",
+            .method = method,
+            .handler = &WifiConfigurationAp::Dispatch,
+            .user_ctx = this
+        };
+        ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &dispatcher));
+    }
+
+    // Every scan, the station's included, is pushed to the open streams from
+    // the httpd task; the timer keeps scanning while a page follows them
+    scan_listener_ = WifiScanService::GetInstance().AddListener([this](const WifiScanService::Snapshot&) {
+        httpd_queue_work(server_, [](void *arg) {
+            static_cast<WifiConfigurationAp *>(arg)->SyncScanFeed();
+        }, this);
+    });
+    esp_timer_create_args_t scan_timer_args = {
+        .callback = [](void *arg) {
+            auto *this_ = static_cast<WifiConfigurationAp *>(arg);
+            if (!this_->is_connecting_ && !this_->uploading_) {
+                WifiScanService::GetInstance().RequestScan();
             }
-            httpd_resp_sendstr_chunk(req, "]}");
-            httpd_resp_sendstr_chunk(req, NULL);
-            return ESP_OK;
         },
-        .user_ctx = this
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "portal_scan",
+        .skip_unhandled_events = true
     };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &scan));
-
-    // Register the form submission
-    httpd_uri_t form_submit = {
-        .uri = "/submit",
-        .method = HTTP_POST,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            char *buf;
-            size_t buf_len = req->content_len;
-            if (buf_len > 1024) { // 限制最大请求体大小
-                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Payload too large");
-                return ESP_FAIL;
-            }
+    ESP_ERROR_CHECK(esp_timer_create(&scan_timer_args, &scan_timer_));
 
-            buf = (char *)malloc(buf_len + 1);
-            if (!buf) {
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to allocate memory");
-                return ESP_FAIL;
-            }
+    ESP_LOGI(TAG, "Web server started");
+}
 
-            int ret = httpd_req_recv(req, buf, buf_len);
-            if (ret <= 0) {
-                free(buf);
-                if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                    httpd_resp_send_408(req);
-                } else {
-                    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive request");
-                }
-                return ESP_FAIL;
-            }
-            buf[ret] = '\0';
-
-            // 解析 JSON 数据
-            cJSON *json = cJSON_Parse(buf);
-            free(buf);
-            if (!json) {
-                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-                return ESP_FAIL;
-            }
+// Each page gets its own instantiation, so asset routes fit the plain handler signature.
+// A newer copy from the asset bundle in the storage partition wins over the embedded one.
+template <size_t I>
+static esp_err_t ServePortalAssetAt(httpd_req_t *req)
+{
+    esp_err_t ret = ESP_OK;
+    bool bundled = AssetBundle::GetInstance().Use(kPortalAssets[I].uri, kPortalAssetsVersion,
+        [&](const AssetBundle::Asset& asset) {
+            ret = ServePortalAsset(req, {asset.uri, asset.content_type, asset.data, asset.length, asset.etag});
+        });
+    return bundled ? ret : ServePortalAsset(req, kPortalAssets[I]);
+}
 
-            cJSON *ssid_item = cJSON_GetObjectItemCaseSensitive(json, "ssid");
-            cJSON *password_item = cJSON_GetObjectItemCaseSensitive(json, "password");
+template <size_t... I>
+static constexpr std::array<PortalRoute, sizeof...(I)> PortalAssetRoutes(std::index_sequence<I...>)
+{
+    return {{{kPortalAssets[I].uri, HTTP_GET, &ServePortalAssetAt<I>, false}...}};
+}
 
-            if (!cJSON_IsString(ssid_item) || (ssid_item->valuestring == NULL) || (strlen(ssid_item->valuestring) >= 33)) {
-                cJSON_Delete(json);
-                httpd_resp_send(req, "{\"success\":false,\"error\":\"Invalid SSID\"}", HTTPD_RESP_USE_STRLEN);
-                return ESP_OK;
-            }
+const PortalRoute* WifiConfigurationAp::FindRoute(httpd_method_t method, std::string_view path)
+{
+    static constexpr std::array<PortalRoute, 22> kRoutes = {{
+        {"/saved/list",         HTTP_GET,  &HandleSavedList,       false},
+        {"/saved/set_default",  HTTP_GET,  &HandleSavedSetDefault, true},
+        {"/saved/delete",       HTTP_GET,  &HandleSavedDelete,     true},
+        {"/scan",               HTTP_GET,  &HandleScan,            false},
+        {"/scan/events",        HTTP_GET,  &HandleScanEvents,      false},
+        {"/submit",             HTTP_POST, &HandleSubmit,          false},
+        {"/submit/status",      HTTP_GET,  &HandleSubmitStatus,    false},
+        {"/exit",               HTTP_POST, &HandleExit,            false},
+        {"/advanced/config",    HTTP_GET,  &HandleAdvancedConfig,  false},
+        {"/advanced/submit",    HTTP_POST, &HandleAdvancedSubmit,  true},
+        {"/ota/upload",         HTTP_POST, &HandleOtaUpload,       true},
+        {"/ota/events",         HTTP_GET,  &HandleOtaEvents,       false},
+        // Captive portal detection endpoints
+        {"/hotspot-detect.html",        HTTP_GET, &HandleCaptiveProbe, false},  // Apple
+        {"/library/test/success.html",  HTTP_GET, &HandleCaptiveProbe, false},  // Apple
+        {"/generate_204*",              HTTP_GET, &HandleCaptiveProbe, false},  // Android
+        {"/mobile/status.php",          HTTP_GET, &HandleCaptiveProbe, false},  // Android
+        {"/check_network_status.txt",   HTTP_GET, &HandleCaptiveProbe, false},  // Windows
+        {"/ncsi.txt",                   HTTP_GET, &HandleCaptiveProbe, false},  // Windows
+        {"/fwlink/",                    HTTP_GET, &HandleCaptiveProbe, false},  // Microsoft
+        {"/connectivity-check.html",    HTTP_GET, &HandleCaptiveProbe, false},  // Firefox
+        {"/success.txt",                HTTP_GET, &HandleCaptiveProbe, false},  // Various
+        {"/portal.html",                HTTP_GET, &HandleCaptiveProbe, false},  // Various
+    }};
+    static constexpr RouteTable kTable(JoinRoutes(
+        PortalAssetRoutes(std::make_index_sequence<std::size(kPortalAssets)>()), kRoutes));
+    static_assert(kTable.IsValid(), "Route table needs more hash slots");
+    return kTable.Find(method, path);
+}
 
-            std::string ssid_str = ssid_item->valuestring;
-            std::string password_str = "";
-            if (cJSON_IsString(password_item) && (password_item->valuestring != NULL) && (strlen(password_item->valuestring) < 65)) {
-                password_str = password_item->valuestring;
-            }
+// The one registered handler: look the path up and run the route inline or on a worker
+esp_err_t WifiConfigurationAp::Dispatch(httpd_req_t *req)
+{
+    auto* this_ = static_cast<WifiConfigurationAp*>(req->user_ctx);
+    std::string_view path(req->uri);
+    path = path.substr(0, path.find_first_of("?#"));
+
+    const PortalRoute* route = FindRoute(static_cast<httpd_method_t>(req->method), path);
+    if (route == nullptr) {
+        ESP_LOGD(TAG, "No route for %s", req->uri);
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not found");
+    }
+    if (route->offload) {
+        return this_->workers_.Submit(req, route->handler, this_);
+    }
+    return route->handler(req);
+}
 
-            // 获取当前对象
-            auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
-            if (!this_->ConnectToWifi(ssid_str, password_str)) {
-                cJSON_Delete(json);
-                httpd_resp_send(req, "{\"success\":false,\"error\":\"Failed to connect to the Access Point\"}", HTTPD_RESP_USE_STRLEN);
-                return ESP_OK;
-            }
+// GET on any of the OS connectivity probe URLs: send the device to the portal page
+esp_err_t WifiConfigurationAp::HandleCaptiveProbe(httpd_req_t *req)
+{
+    auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
+    std::string url = this_->GetWebServerUrl() + "/?lang=" + this_->language_ + "&_=" + std::to_string(esp_timer_get_time());
+    // Set content type to prevent browser warnings
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", url.c_str());
+    // One-shot OS connectivity probes, not the page: free the socket right away
+    httpd_resp_set_hdr(req, "Connection", "close");
+    httpd_resp_send(req, NULL, 0);
+    return ESP_OK;
+}
 
-            this_->Save(ssid_str, password_str);
-            cJSON_Delete(json);
-            // 设置成功响应
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
-            return ESP_OK;
-        },
-        .user_ctx = this
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &form_submit));
-
-    // Register the done.html page
-    httpd_uri_t done_html = {
-        .uri = "/done.html",
-        .method = HTTP_GET,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_send(req, done_html_start, strlen(done_html_start));
-            return ESP_OK;
-        },
-        .user_ctx = NULL
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &done_html));
-
-    // Register the exit endpoint - exits config mode without rebooting
-    httpd_uri_t exit_config = {
-        .uri = "/exit",
-        .method = HTTP_POST,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            auto* this_ = static_cast<WifiConfigurationAp*>(req->user_ctx);
-            
-            // 设置响应头，防止浏览器缓存
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Cache-Control", "no-store");
-            httpd_resp_set_hdr(req, "Connection", "close");
-            // 发送响应
-            httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
-            
-            // 延迟调用回调，确保HTTP响应完全发送
-            ESP_LOGI(TAG, "Exiting config mode...");
-            xTaskCreate([](void *ctx) {
-                // 等待200ms确保HTTP响应完全发送
-                vTaskDelay(pdMS_TO_TICKS(200));
-                
-                auto* self = static_cast<WifiConfigurationAp*>(ctx);
-                // 通知回调退出配网模式
-                if (self->on_exit_requested_) {
-                    self->on_exit_requested_();
-                }
-                vTaskDelete(NULL);
-            }, "exit_config_task", 4096, this_, 5, NULL);
-            
-            return ESP_OK;
-        },
-        .user_ctx = this
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &exit_config));
-
-    auto captive_portal_handler = [](httpd_req_t *req) -> esp_err_t {
-        auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
-        std::string url = this_->GetWebServerUrl() + "/?lang=" + this_->language_ + "&_=" + std::to_string(esp_timer_get_time());
-        // Set content type to prevent browser warnings
-        httpd_resp_set_type(req, "text/html");
-        httpd_resp_set_status(req, "302 Found");
-        httpd_resp_set_hdr(req, "Location", url.c_str());
-        httpd_resp_set_hdr(req, "Connection", "close");
-        httpd_resp_send(req, NULL, 0);
-        return ESP_OK;
-    };
+// GET /saved/list: the saved SSIDs, default first
+esp_err_t WifiConfigurationAp::HandleSavedList(httpd_req_t *req)
+{
+    auto ssid_list = SsidManager::GetInstance().GetSsidList();
+    httpd_resp_set_type(req, "application/json");
+    char buf[128];
+    JsonWriter json(buf, sizeof(buf), SendChunk, req);
+    json.BeginArray();
+    for (const auto& ssid : *ssid_list) {
+        json.String(ssid.ssid);
+    }
+    json.EndArray();
+    json.Finish();
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
 
-    // Register all common captive portal detection endpoints
-    const char* captive_portal_urls[] = {
-        "/hotspot-detect.html",    // Apple
-        "/generate_204*",           // Android
-        "/mobile/status.php",      // Android
-        "/check_network_status.txt", // Windows
-        "/ncsi.txt",              // Windows
-        "/fwlink/",               // Microsoft
-        "/connectivity-check.html", // Firefox
-        "/success.txt",           // Various
-        "/portal.html",           // Various
-        "/library/test/success.html" // Apple
-    };
+// GET /saved/set_default?index=N
+esp_err_t WifiConfigurationAp::HandleSavedSetDefault(httpd_req_t *req)
+{
+    auto index = QueryString(req).GetNumber<int>("index");
+    if (index) {
+        ESP_LOGI(TAG, "Set default item %d", *index);
+        SsidManager::GetInstance().SetDefaultSsid(*index);
+    }
+    // send {}
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
 
-    for (const auto& url : captive_portal_urls) {
-        httpd_uri_t redirect_uri = {
-            .uri = url,
-            .method = HTTP_GET,
-            .handler = captive_portal_handler,
-            .user_ctx = this
-        };
-        ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &redirect_uri));
-    }
-
-    // Register the /advanced/config URI
-    httpd_uri_t advanced_config = {
-        .uri = "/advanced/config",
-        .method = HTTP_GET,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            // 获取当前对象
-            auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
-            
-            // 创建JSON对象
-            cJSON *json = cJSON_CreateObject();
-            if (!json) {
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create JSON");
-                return ESP_FAIL;
-            }
+// GET /saved/delete?index=N
+esp_err_t WifiConfigurationAp::HandleSavedDelete(httpd_req_t *req)
+{
+    auto index = QueryString(req).GetNumber<int>("index");
+    if (index) {
+        ESP_LOGI(TAG, "Delete saved list item %d", *index);
+        SsidManager::GetInstance().RemoveSsid(*index);
+    }
+    // send {}
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
 
-            // 添加配置项到JSON
-            if (!this_->ota_url_.empty()) {
-                cJSON_AddStringToObject(json, "ota_url", this_->ota_url_.c_str());
-            }
-            if (!this_->google_sheet_url_.empty()) {
-                cJSON_AddStringToObject(json, "google_sheet_url", this_->google_sheet_url_.c_str());
-            }
-            if (!this_->google_sheet_url_2_.empty()) {
-                cJSON_AddStringToObject(json, "google_sheet_url_2", this_->google_sheet_url_2_.c_str());
-            }
-            if (!this_->vibo_key_.empty()) {
-                cJSON_AddStringToObject(json, "vibo_key", this_->vibo_key_.c_str());
-            }
-            cJSON_AddNumberToObject(json, "max_tx_power", this_->max_tx_power_);
-            cJSON_AddBoolToObject(json, "remember_bssid", this_->remember_bssid_);
-            cJSON_AddBoolToObject(json, "sleep_mode", this_->sleep_mode_);
-
-            // 发送JSON响应
-            char *json_str = cJSON_PrintUnformatted(json);
-            cJSON_Delete(json);
-            if (!json_str) {
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to print JSON");
-                return ESP_FAIL;
-            }
+// GET /scan: the AP list in one write
+esp_err_t WifiConfigurationAp::HandleScan(httpd_req_t *req)
+{
+    auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
+    // Serve the cache right away; a stale one is refreshed for the next poll
+    this_->RefreshScan(WifiScanService::GetInstance().GetResults());
+    this_->SyncScanFeed();
+    ScanFeed::Json json = this_->scan_feed_.GetJson();
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json->data(), json->size());
+}
 
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_send(req, json_str, strlen(json_str));
-            free(json_str);
-            return ESP_OK;
-        },
-        .user_ctx = this
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &advanced_config));
-
-    // Register the /advanced/submit URI
-    httpd_uri_t advanced_submit = {
-        .uri = "/advanced/submit",
-        .method = HTTP_POST,
-        .handler = [](httpd_req_t *req) -> esp_err_t {
-            char *buf;
-            size_t buf_len = req->content_len;
-            if (buf_len > 1024) {
-                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Payload too large");
-                return ESP_FAIL;
-            }
+// GET /scan/events: the AP list as Server-Sent Events
+esp_err_t WifiConfigurationAp::HandleScanEvents(httpd_req_t *req)
+{
+    return static_cast<WifiConfigurationAp *>(req->user_ctx)->OpenScanStream(req);
+}
 
-            buf = (char *)malloc(buf_len + 1);
-            if (!buf) {
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to allocate memory");
-                return ESP_FAIL;
-            }
+// POST /submit: start a connection job for {"ssid","password"}
+esp_err_t WifiConfigurationAp::HandleSubmit(httpd_req_t *req)
+{
+    char buf[kMaxSubmitBody];
+    std::string_view body;
+    if (!ReceiveBody(req, buf, sizeof(buf), body)) {
+        return ESP_FAIL;
+    }
 
-            int ret = httpd_req_recv(req, buf, buf_len);
-            if (ret <= 0) {
-                free(buf);
-                if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                    httpd_resp_send_408(req);
-                } else {
-                    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive request");
+    // 解析 JSON 数据
+    SsidString ssid_str;
+    PasswordString password_str;
+    bool ssid_ok = false;
+    JsonReader json(body);
+    std::string_view key;
+    if (json.EnterObject()) {
+        while (json.NextKey(key)) {
+            bool truncated = false;
+            if (key == "ssid") {
+                ssid_ok = json.ReadString(ssid_str, &truncated) && !truncated;
+            } else if (key == "password") {
+                if (!json.ReadString(password_str, &truncated) || truncated) {
+                    password_str.clear();
                 }
-                return ESP_FAIL;
-            }
-            buf[ret] = '\0';
-
-            // 解析JSON数据
-            cJSON *json = cJSON_Parse(buf);
-            free(buf);
-            if (!json) {
-                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-                return ESP_FAIL;
+            } else {
+                json.SkipValue();
             }
+        }
+    }
+    if (!json.ok()) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
 
-            // 获取当前对象
-            auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
+    httpd_resp_set_type(req, "application/json");
+    if (!ssid_ok) {
+        httpd_resp_send(req, "{\"success\":false,\"error\":\"Invalid SSID\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
 
-            // 打开NVS
-            nvs_handle_t nvs;
-            esp_err_t err = nvs_open("wifi", NVS_READWRITE, &nvs);
-            if (err != ESP_OK) {
-                cJSON_Delete(json);
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open NVS");
-                return ESP_FAIL;
-            }
+    // 获取当前对象
+    auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
+    // The test connect runs on a job task; the page polls /submit/status
+    uint32_t job_id = this_->StartConnectJob(ssid_str, password_str);
+    if (job_id == 0) {
+        httpd_resp_send(req, "{\"success\":false,\"error\":\"A connection attempt is already in progress\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    char resp[48];
+    JsonWriter writer(resp, sizeof(resp));
+    writer.BeginObject().Key("success").Bool(true).Key("job").Int(job_id).EndObject();
+    writer.Finish();
+    httpd_resp_send(req, writer.View().data(), writer.View().size());
+    return ESP_OK;
+}
 
-            // 保存OTA URL
-            cJSON *ota_url = cJSON_GetObjectItem(json, "ota_url");
-            if (cJSON_IsString(ota_url) && ota_url->valuestring) {
-                this_->ota_url_ = ota_url->valuestring;
-                err = nvs_set_str(nvs, "ota_url", this_->ota_url_.c_str());
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to save OTA URL: %d", err);
-                }
-            }
+// GET /submit/status?id=N: progress of the job started by /submit
+esp_err_t WifiConfigurationAp::HandleSubmitStatus(httpd_req_t *req)
+{
+    auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
+    uint32_t job_id = QueryString(req).GetNumber<uint32_t>("id").value_or(0);
+    auto job = this_->GetConnectJob();
+    if (job_id == 0 || job.id != job_id) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown job");
+        return ESP_FAIL;
+    }
 
-            // 保存WiFi功率
-            cJSON *max_tx_power = cJSON_GetObjectItem(json, "max_tx_power");
-            if (cJSON_IsNumber(max_tx_power)) {
-                this_->max_tx_power_ = max_tx_power->valueint;
-                err = esp_wifi_set_max_tx_power(this_->max_tx_power_);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to set WiFi power: %d", err);
-                    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set WiFi power");
-                    return ESP_FAIL;
-                }
-                err = nvs_set_i8(nvs, "max_tx_power", this_->max_tx_power_);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to save WiFi power: %d", err);
-                }
-            }
+    char resp[128];
+    JsonWriter writer(resp, sizeof(resp));
+    writer.BeginObject().Key("job").Int(job.id).Key("state");
+    switch (job.state) {
+        case ConnectJobState::kConnecting:
+            writer.String("connecting");
+            break;
+        case ConnectJobState::kSucceeded:
+            writer.String("success");
+            break;
+        case ConnectJobState::kFailed:
+            writer.String("failed").Key("error").String(job.error);
+            break;
+    }
+    writer.EndObject();
+    writer.Finish();
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_send(req, writer.View().data(), writer.View().size());
+    return ESP_OK;
+}
 
-            // 保存BSSID记忆设置
-            cJSON *remember_bssid = cJSON_GetObjectItem(json, "remember_bssid");
-            if (cJSON_IsBool(remember_bssid)) {
-                this_->remember_bssid_ = cJSON_IsTrue(remember_bssid);
-                err = nvs_set_u8(nvs, "remember_bssid", this_->remember_bssid_ ? 1 : 0);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to save remember_bssid: %d", err);
-                }
-            }
+// POST /exit: leave config mode without rebooting
+esp_err_t WifiConfigurationAp::HandleExit(httpd_req_t *req)
+{
+    auto* this_ = static_cast<WifiConfigurationAp*>(req->user_ctx);
+    
+    // 设置响应头，防止浏览器缓存
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    // 发送响应
+    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
+    
+    // 延迟调用回调，确保HTTP响应完全发送
+    ESP_LOGI(TAG, "Exiting config mode...");
+    this_->RequestExit(200);
+    
+    return ESP_OK;
+}
 
-            // 保存睡眠模式设置
-            cJSON *sleep_mode = cJSON_GetObjectItem(json, "sleep_mode");
-            if (cJSON_IsBool(sleep_mode)) {
-                this_->sleep_mode_ = cJSON_IsTrue(sleep_mode);
-                err = nvs_set_u8(nvs, "sleep_mode", this_->sleep_mode_ ? 1 : 0);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to save sleep_mode: %d", err);
-                }
-            }
+// GET /advanced/config
+esp_err_t WifiConfigurationAp::HandleAdvancedConfig(httpd_req_t *req)
+{
+    // 以 JSON 流式发送配置; the config is on the heap, the httpd task stack
+    // also holds the writer and its buffer
+    std::unique_ptr<WifiAdvancedConfig> config(new (std::nothrow) WifiAdvancedConfig(WifiConfigStore::GetInstance().Get()));
+    if (!config) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    char buf[128];
+    JsonWriter json(buf, sizeof(buf), SendChunk, req);
+    json.BeginObject();
+    if (!config->ota_url.empty()) {
+        json.Key("ota_url").String(config->ota_url);
+    }
+    if (!config->google_sheet_url.empty()) {
+        json.Key("google_sheet_url").String(config->google_sheet_url);
+    }
+    if (!config->google_sheet_url_2.empty()) {
+        json.Key("google_sheet_url_2").String(config->google_sheet_url_2);
+    }
+    if (!config->vibo_key.empty()) {
+        json.Key("vibo_key").String(config->vibo_key);
+    }
+    json.Key("max_tx_power").Int(config->max_tx_power != 0 ? config->max_tx_power : kDefaultMaxTxPower);
+    json.Key("remember_bssid").Bool(config->remember_bssid);
+    json.Key("sleep_mode").Bool(config->sleep_mode);
+    json.Key("firmware_upload").Bool(static_cast<WifiConfigurationAp *>(req->user_ctx)->firmware_upload_);
+    json.EndObject();
+    if (!json.Finish()) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
 
-            // Save Google Sheet URL 1
-            cJSON *gs_url = cJSON_GetObjectItem(json, "google_sheet_url");
-            if (cJSON_IsString(gs_url)) {
-                if (gs_url->valuestring) {
-                    this_->google_sheet_url_ = gs_url->valuestring;
-                } else {
-                    this_->google_sheet_url_ = "";
-                }
-                err = nvs_set_str(nvs, "gs_url", this_->google_sheet_url_.c_str());
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to save Google Sheet URL 1: %d", err);
-                }
-            }
+// POST /advanced/submit
+esp_err_t WifiConfigurationAp::HandleAdvancedSubmit(httpd_req_t *req)
+{
+    // Body and config on the heap: this runs on a 4 KB worker stack, and
+    // WifiConfigStore::Update() plus NVS need most of it
+    std::unique_ptr<char[]> buf(new (std::nothrow) char[kMaxAdvancedBody]);
+    std::unique_ptr<WifiAdvancedConfig> incoming(new (std::nothrow) WifiAdvancedConfig(WifiConfigStore::GetInstance().Get()));
+    if (!buf || !incoming) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    std::string_view body;
+    if (!ReceiveBody(req, buf.get(), kMaxAdvancedBody, body)) {
+        return ESP_FAIL;
+    }
 
-            // Save Google Sheet URL 2
-            cJSON *gs_url_2 = cJSON_GetObjectItem(json, "google_sheet_url_2");
-            if (cJSON_IsString(gs_url_2)) {
-                if (gs_url_2->valuestring) {
-                    this_->google_sheet_url_2_ = gs_url_2->valuestring;
-                } else {
-                    this_->google_sheet_url_2_ = "";
-                }
-                err = nvs_set_str(nvs, "gs_url_2", this_->google_sheet_url_2_.c_str());
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to save Google Sheet URL 2: %d", err);
-                }
-            }
-            
-            // Save VIBO-KEY
-            cJSON *v_key = cJSON_GetObjectItem(json, "vibo_key");
-            if (cJSON_IsString(v_key)) {
-                 if (v_key->valuestring) {
-                    this_->vibo_key_ = v_key->valuestring;
-                } else {
-                    this_->vibo_key_ = "";
-                }
-                err = nvs_set_str(nvs, "vibo_key", this_->vibo_key_.c_str());
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to save VIBO-KEY: %d", err);
-                }
+    // 解析JSON数据: members present in the body replace the current values
+    bool has_tx_power = false;
+    JsonReader json(body);
+    std::string_view key;
+    auto string_field = [&json, &key](auto& value) {
+        bool truncated = false;
+        if (json.ReadString(value, &truncated) && truncated) {
+            ESP_LOGW(TAG, "%.*s longer than %d bytes, truncated", (int)key.size(), key.data(), (int)value.capacity());
+        }
+    };
+    if (json.EnterObject()) {
+        while (json.NextKey(key)) {
+            if (key == "ota_url") {
+                string_field(incoming->ota_url);
+            } else if (key == "google_sheet_url") {
+                string_field(incoming->google_sheet_url);
+            } else if (key == "google_sheet_url_2") {
+                string_field(incoming->google_sheet_url_2);
+            } else if (key == "vibo_key") {
+                string_field(incoming->vibo_key);
+            } else if (key == "max_tx_power") {
+                has_tx_power = json.ReadInt(incoming->max_tx_power);
+            } else if (key == "remember_bssid") {
+                json.ReadBool(incoming->remember_bssid);
+            } else if (key == "sleep_mode") {
+                json.ReadBool(incoming->sleep_mode);
+            } else {
+                json.SkipValue();
             }
+        }
+    }
+    if (!json.ok()) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
 
-            // 提交更改
-            err = nvs_commit(nvs);
-            nvs_close(nvs);
-            cJSON_Delete(json);
+    // 应用WiFi功率
+    if (has_tx_power) {
+        esp_err_t err = esp_wifi_set_max_tx_power(incoming->max_tx_power);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to set WiFi power: %d", err);
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set WiFi power");
+            return ESP_FAIL;
+        }
+    }
 
-            if (err != ESP_OK) {
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save configuration");
-                return ESP_FAIL;
-            }
+    // All fields in one batch: only changed keys are written, one nvs_commit
+    esp_err_t err = WifiConfigStore::GetInstance().Update([&incoming](WifiAdvancedConfig& config) {
+        config = *incoming;
+    });
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save configuration");
+        return ESP_FAIL;
+    }
 
-            // 发送成功响应
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "close");
-            httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
+    // 发送成功响应
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
 
-            ESP_LOGI(TAG, "Saved settings: ota_url=%s, max_tx_power=%d, remember_bssid=%d, sleep_mode=%d",
-                this_->ota_url_.c_str(), this_->max_tx_power_, this_->remember_bssid_, this_->sleep_mode_);
-            return ESP_OK;
-        },
-        .user_ctx = this
-    };
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server_, &advanced_submit));
+    ESP_LOGI(TAG, "Saved settings: ota_url=%s, max_tx_power=%d, remember_bssid=%d, sleep_mode=%d",
+        incoming->ota_url.c_str(), incoming->max_tx_power, incoming->remember_bssid, incoming->sleep_mode);
+    return ESP_OK;
+}
 
-    ESP_LOGI(TAG, "Web server started");
+// POST /ota/upload: the raw firmware image as the body, flashed as it arrives.
+// Runs on a worker; progress goes out on /ota/events, then the device restarts.
+esp_err_t WifiConfigurationAp::HandleOtaUpload(httpd_req_t *req)
+{
+    auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
+    if (!this_->firmware_upload_) {
+        httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Firmware upload is disabled");
+        return ESP_FAIL;
+    }
+    if (req->content_len == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty firmware image");
+        return ESP_FAIL;
+    }
+
+    const char *error = "An upload is already in progress";
+    bool expected = false;
+    if (this_->uploading_.compare_exchange_strong(expected, true)) {
+        error = this_->ReceiveFirmware(req);
+        this_->uploading_ = false;
+    }
+
+    char resp[128];
+    JsonWriter writer(resp, sizeof(resp));
+    writer.BeginObject().Key("success").Bool(error == nullptr);
+    if (error != nullptr) {
+        writer.Key("error").String(error);
+    }
+    writer.EndObject();
+    writer.Finish();
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, writer.View().data(), writer.View().size());
+
+    if (error == nullptr) {
+        ESP_LOGI(TAG, "Firmware uploaded, restarting...");
+        OtaManager::GetInstance().Restart();
+    }
+    return ESP_OK;
 }
 
-bool WifiConfigurationAp::ConnectToWifi(const std::string &ssid, const std::string &password)
+// Streams the request body into OtaManager's write path; nullptr on success,
+// otherwise what to tell the page
+const char *WifiConfigurationAp::ReceiveFirmware(httpd_req_t *req)
 {
-    if (ssid.empty()) {
-        ESP_LOGE(TAG, "SSID cannot be empty");
-        return false;
+    auto &ota = OtaManager::GetInstance();
+    size_t total = req->content_len;
+    SetUploadStatus({UploadState::kReceiving, 0, total, nullptr});
+    ESP_LOGI(TAG, "Receiving firmware (%zu bytes)", total);
+
+    const char *error = nullptr;
+    esp_err_t err = ota.BeginWrite(total);
+    if (err == ESP_ERR_INVALID_STATE) {
+        error = "An update is already running";
+    } else if (err == ESP_ERR_INVALID_SIZE) {
+        error = "Image is larger than the OTA partition";
+    } else if (err != ESP_OK) {
+        error = "Cannot start the update";
     }
-    
-    if (ssid.length() > 32) {  // WiFi SSID 最大长度
-        ESP_LOGE(TAG, "SSID too long");
-        return false;
+    if (error != nullptr) {
+        SetUploadStatus({UploadState::kFailed, 0, total, error});
+        return error;
+    }
+
+    char *buf = (char *)malloc(kUploadChunkSize);
+    size_t received = 0;
+    size_t notified = 0;   // Percent last pushed
+    int timeouts = 0;
+    if (buf == nullptr) {
+        error = "Out of memory";
+    }
+    while (error == nullptr && received < total) {
+        if (!active_) {
+            error = "Portal stopped";
+            break;
+        }
+        int ret = httpd_req_recv(req, buf, std::min(kUploadChunkSize, total - received));
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= kMaxUploadTimeouts) {
+            continue;
+        }
+        if (ret <= 0) {
+            error = "Upload interrupted";
+            break;
+        }
+        timeouts = 0;
+
+        err = ota.Write(buf, ret);
+        if (err == ESP_ERR_NOT_SUPPORTED) {
+            error = "Firmware is for a different project";
+        } else if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            error = "Not a firmware image";
+        } else if (err != ESP_OK) {
+            error = "Flash write failed";
+        }
+        received += ret;
+
+        size_t percent = received * 100 / total;
+        if (error == nullptr && percent != notified) {
+            notified = percent;
+            SetUploadStatus({UploadState::kReceiving, received, total, nullptr});
+        }
+    }
+    free(buf);
+
+    if (error != nullptr) {
+        ESP_LOGW(TAG, "Firmware upload failed after %zu bytes: %s", received, error);
+        ota.AbortWrite();
+        SetUploadStatus({UploadState::kFailed, received, total, error});
+        return error;
+    }
+
+    SetUploadStatus({UploadState::kVerifying, received, total, nullptr});
+    err = ota.EndWrite();
+    if (err != ESP_OK) {
+        error = err == ESP_ERR_OTA_VALIDATE_FAILED ? "Firmware image is corrupted" : "Cannot activate the new firmware";
+        SetUploadStatus({UploadState::kFailed, received, total, error});
+        return error;
     }
+    SetUploadStatus({UploadState::kSucceeded, received, total, nullptr});
+    return nullptr;
+}
 
-    if (password.length() > 64) {
-        ESP_LOGE(TAG, "Password too long");
+// GET /ota/events: upload progress for the page that sent the image
+esp_err_t WifiConfigurationAp::HandleOtaEvents(httpd_req_t *req)
+{
+    auto *this_ = static_cast<WifiConfigurationAp *>(req->user_ctx);
+    httpd_req_t *stream = BeginEventStream(req, this_->upload_streams_.size(), kMaxUploadStreams);
+    if (stream == nullptr) {
+        return ESP_OK;
+    }
+    this_->upload_streams_.push_back(stream);
+    // Start from the current status, the upload may be under way already
+    this_->PushUploadEvent();
+    return ESP_OK;
+}
+
+bool WifiConfigurationAp::ConnectToWifi(const SsidString &ssid, const PasswordString &password)
+{
+    // Lengths are bounded by the types (32 / 64, the wifi_sta_config_t limits)
+    if (ssid.empty()) {
+        ESP_LOGE(TAG, "SSID cannot be empty");
         return false;
     }
     
+    // A running station gives up its association for the duration of the test
+    if (station_control_) {
+        station_control_(true);
+    }
     is_connecting_ = true;
+    last_disconnect_reason_ = 0;
     esp_wifi_scan_stop();
     xEventGroupClearBits(event_group_, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    {
+        // Checked after the clear: a Stop() that came earlier set its fail bit too soon to count
+        std::lock_guard<std::mutex> lock(job_mutex_);
+        if (job_.stop_requested) {
+            is_connecting_ = false;
+            if (station_control_) {
+                station_control_(false);
+            }
+            return false;
+        }
+    }
 
     wifi_config_t wifi_config;
     bzero(&wifi_config, sizeof(wifi_config));
-    strlcpy((char *)wifi_config.sta.ssid, ssid.c_str(), 32);
-    strlcpy((char *)wifi_config.sta.password, password.c_str(), 64);
+    memcpy(wifi_config.sta.ssid, ssid.data(), ssid.size());
+    memcpy(wifi_config.sta.password, password.data(), password.size());
     wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
     wifi_config.sta.failure_retry_cnt = 1;
+
+    // Pick the BSSID from the last scan with the same policy as the station
+    if (auto results = WifiScanService::GetInstance().GetResults()) {
+        const wifi_ap_record_t* best = selector_.SelectBest(ssid.c_str(), results->records.data(), results->records.size());
+        if (best != nullptr) {
+            ESP_LOGI(TAG, "Selected BSSID " MACSTR " on channel %d", MAC2STR(best->bssid), best->primary);
+            memcpy(wifi_config.sta.bssid, best->bssid, 6);
+            wifi_config.sta.bssid_set = true;
+            wifi_config.sta.channel = best->primary;
+        }
+    }
     
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     auto ret = esp_wifi_connect();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to connect to WiFi: %d", ret);
         is_connecting_ = false;
+        if (station_control_) {
+            station_control_(false);
+        }
         return false;
     }
     ESP_LOGI(TAG, "Connecting to WiFi %s", ssid.c_str());
@@ -787,38 +1091,165 @@ bool WifiConfigurationAp::ConnectToWifi(const std::string &ssid, const std::stri
         WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
         pdTRUE,
         pdFALSE,
-#ifdef CONFIG_SOC_WIFI_SUPPORT_5G
-        pdMS_TO_TICKS(25000)
-#else
-        pdMS_TO_TICKS(10000)
-#endif
+        pdMS_TO_TICKS(kConnectTimeoutMs)
     );
     is_connecting_ = false;
 
-    if (bits & WIFI_CONNECTED_BIT) {
+    bool connected = (bits & WIFI_CONNECTED_BIT) != 0;
+    if (connected) {
         ESP_LOGI(TAG, "Connected to WiFi %s", ssid.c_str());
+        // The station resumes only after this disconnect is reported, or it
+        // would count it as a failure of its own
+        xEventGroupClearBits(event_group_, WIFI_DISCONNECTED_BIT);
         esp_wifi_disconnect();
-        return true;
+        bits = xEventGroupWaitBits(event_group_, WIFI_DISCONNECTED_BIT, pdTRUE, pdFALSE,
+                                   pdMS_TO_TICKS(kDisconnectTimeoutMs));
+        if ((bits & WIFI_DISCONNECTED_BIT) == 0) {
+            ESP_LOGW(TAG, "No disconnect event within %d ms", kDisconnectTimeoutMs);
+        }
     } else {
         ESP_LOGE(TAG, "Failed to connect to WiFi %s", ssid.c_str());
-        return false;
     }
+    if (station_control_) {
+        station_control_(false);
+    }
+    return connected;
 }
 
-void WifiConfigurationAp::Save(const std::string &ssid, const std::string &password)
+void WifiConfigurationAp::Save(std::string_view ssid, std::string_view password)
 {
-    ESP_LOGI(TAG, "Save SSID %s %d", ssid.c_str(), ssid.length());
+    ESP_LOGI(TAG, "Save SSID %.*s %d", (int)ssid.size(), ssid.data(), (int)ssid.size());
     SsidManager::GetInstance().AddSsid(ssid, password);
 }
 
+// Only one job at a time: the test connect borrows the single STA interface
+uint32_t WifiConfigurationAp::StartConnectJob(const SsidString &ssid, const PasswordString &password)
+{
+    std::lock_guard<std::mutex> lock(job_mutex_);
+    if (job_.running || !active_) {
+        return 0;
+    }
+    job_.status = {next_job_id_++, ConnectJobState::kConnecting, nullptr};
+    job_.ssid = ssid;
+    job_.password = password;
+    job_.running = true;
+    if (xTaskCreate(&WifiConfigurationAp::ConnectJobTask, "wifi_connect_job", 4096, this, 5, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the connect job task");
+        job_.status = {job_.status.id, ConnectJobState::kFailed, "Out of memory"};
+        job_.running = false;
+    }
+    return job_.status.id;
+}
+
+WifiConfigurationAp::ConnectJobStatus WifiConfigurationAp::GetConnectJob()
+{
+    std::lock_guard<std::mutex> lock(job_mutex_);
+    return job_.status;
+}
+
+static const char* DescribeConnectFailure(uint8_t reason)
+{
+    switch (reason) {
+        case WIFI_REASON_AUTH_FAIL:
+        case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+        case WIFI_REASON_HANDSHAKE_TIMEOUT:
+        case WIFI_REASON_802_1X_AUTH_FAILED:
+            return "Wrong password";
+        case WIFI_REASON_NO_AP_FOUND:
+            return "Access Point not found";
+        default:
+            return "Failed to connect to the Access Point";
+    }
+}
+
+void WifiConfigurationAp::ConnectJobTask(void* arg)
+{
+    auto* this_ = static_cast<WifiConfigurationAp*>(arg);
+    SsidString ssid;
+    PasswordString password;
+    {
+        std::lock_guard<std::mutex> lock(this_->job_mutex_);
+        ssid = this_->job_.ssid;
+        password = this_->job_.password;
+    }
+
+    bool connected = this_->active_ && this_->ConnectToWifi(ssid, password);
+    if (connected) {
+        this_->Save(ssid, password);
+    }
+
+    TaskHandle_t waiter;
+    {
+        std::lock_guard<std::mutex> lock(this_->job_mutex_);
+        auto& status = this_->job_.status;
+        status.state = connected ? ConnectJobState::kSucceeded : ConnectJobState::kFailed;
+        status.error = connected ? nullptr : DescribeConnectFailure(this_->last_disconnect_reason_);
+        this_->job_.password.clear();
+        this_->job_.running = false;
+        this_->job_.stop_requested = false;
+        waiter = this_->job_.stop_waiter;
+        this_->job_.stop_waiter = nullptr;
+    }
+    // No access to this_ from here on: once running is cleared Stop() may destroy it
+    if (waiter != nullptr) {
+        xTaskNotifyGive(waiter);
+    }
+    vTaskDelete(NULL);
+}
+
+// Join a running job; the stop flag or the fail bit cuts its connection wait short.
+// No timeout: the job runs on this_, and its own wait is bounded by kConnectTimeoutMs.
+void WifiConfigurationAp::StopConnectJob()
+{
+    {
+        std::lock_guard<std::mutex> lock(job_mutex_);
+        if (!job_.running) {
+            return;
+        }
+        job_.stop_requested = true;
+        job_.stop_waiter = xTaskGetCurrentTaskHandle();
+    }
+    xEventGroupSetBits(event_group_, WIFI_FAIL_BIT);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+void WifiConfigurationAp::SetStationControl(std::function<void(bool suspend)> control)
+{
+    station_control_ = control;
+}
+
 void WifiConfigurationAp::OnExitRequested(std::function<void()> callback)
 {
     on_exit_requested_ = callback;
 }
 
+// The exit task owns a copy of the callback: WifiManager destroys this object
+// when the config session ends, possibly before the task runs
+void WifiConfigurationAp::RequestExit(int delay_ms)
+{
+    if (!on_exit_requested_) {
+        return;
+    }
+    struct ExitRequest {
+        std::function<void()> callback;
+        int delay_ms;
+    };
+    auto* request = new ExitRequest{on_exit_requested_, delay_ms};
+    xTaskCreate([](void *ctx) {
+        auto* request = static_cast<ExitRequest*>(ctx);
+        vTaskDelay(pdMS_TO_TICKS(request->delay_ms));
+        request->callback();
+        delete request;
+        vTaskDelete(NULL);
+    }, "exit_config_task", 4096, request, 5, NULL);
+}
+
 void WifiConfigurationAp::WifiEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
     WifiConfigurationAp* self = static_cast<WifiConfigurationAp*>(arg);
+    if (!self->active_) {
+        return;
+    }
     if (event_id == WIFI_EVENT_AP_STACONNECTED) {
         wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
         ESP_LOGI(TAG, "Station " MACSTR " joined, AID=%d", MAC2STR(event->mac), event->aid);
@@ -828,23 +1259,24 @@ void WifiConfigurationAp::WifiEventHandler(void* arg, esp_event_base_t event_bas
     } else if (event_id == WIFI_EVENT_STA_CONNECTED) {
         xEventGroupSetBits(self->event_group_, WIFI_CONNECTED_BIT);
     } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        auto* event = static_cast<wifi_event_sta_disconnected_t*>(event_data);
+        xEventGroupSetBits(self->event_group_, WIFI_DISCONNECTED_BIT);
+        // Only failures of the test connect count. ASSOC_LEAVE is the echo of an
+        // esp_wifi_disconnect() (the suspended station, or the end of the last test).
+        if (!self->is_connecting_ || event->reason == WIFI_REASON_ASSOC_LEAVE) {
+            return;
+        }
+        self->last_disconnect_reason_ = event->reason;
         xEventGroupSetBits(self->event_group_, WIFI_FAIL_BIT);
-    } else if (event_id == WIFI_EVENT_SCAN_DONE) {
-        std::lock_guard<std::mutex> lock(self->mutex_);
-        uint16_t ap_num = 0;
-        esp_wifi_scan_get_ap_num(&ap_num);
-
-        self->ap_records_.resize(ap_num);
-        esp_wifi_scan_get_ap_records(&ap_num, self->ap_records_.data());
-
-        // 扫描完成，等待10秒后再次扫描
-        esp_timer_start_once(self->scan_timer_, 10 * 1000000);
     }
 }
 
 void WifiConfigurationAp::IpEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
     WifiConfigurationAp* self = static_cast<WifiConfigurationAp*>(arg);
+    if (!self->active_) {
+        return;
+    }
     if (event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
@@ -886,22 +1318,16 @@ void WifiConfigurationAp::SmartConfigEventHandler(void *arg, esp_event_base_t ev
             ESP_LOGI(TAG, "Got SmartConfig credentials");
             smartconfig_event_got_ssid_pswd_t *evt = (smartconfig_event_got_ssid_pswd_t *)event_data;
 
-            char ssid[32], password[64];
-            memcpy(ssid, evt->ssid, sizeof(evt->ssid));
-            memcpy(password, evt->password, sizeof(evt->password));
-            ESP_LOGI(TAG, "SmartConfig SSID: %s, Password: %s", ssid, password);
+            // Fields are fixed-size and not NUL-terminated when full
+            SsidString ssid(std::string_view((const char *)evt->ssid, strnlen((const char *)evt->ssid, sizeof(evt->ssid))));
+            PasswordString password(std::string_view((const char *)evt->password,
+                                                     strnlen((const char *)evt->password, sizeof(evt->password))));
+            ESP_LOGI(TAG, "SmartConfig SSID: %s, Password: %s", ssid.c_str(), password.c_str());
             // 尝试连接WiFi会失败，故不连接
             self->Save(ssid, password);
             // 延迟退出配网模式
-            xTaskCreate([](void *ctx){
-                ESP_LOGI(TAG, "Exiting config mode in 1 second");
-                vTaskDelay(pdMS_TO_TICKS(1000));
-                auto* self = static_cast<WifiConfigurationAp*>(ctx);
-                if (self->on_exit_requested_) {
-                    self->on_exit_requested_();
-                }
-                vTaskDelete(NULL);
-            }, "exit_config_task", 4096, self, 5, NULL);
+            ESP_LOGI(TAG, "Exiting config mode in 1 second");
+            self->RequestExit(1000);
             break;
         }
         case SC_EVENT_SEND_ACK_DONE:
@@ -913,7 +1339,12 @@ void WifiConfigurationAp::SmartConfigEventHandler(void *arg, esp_event_base_t ev
 }
 #endif // !CONFIG_IDF_TARGET_ESP32P4
 
-void WifiConfigurationAp::Stop() {
+void WifiConfigurationAp::Stop(bool keep_driver) {
+    // Only the first call tears down, so a later one can't stop the driver
+    // that the first call kept running
+    if (!active_.exchange(false)) {
+        return;
+    }
 #if !CONFIG_IDF_TARGET_ESP32P4
     // 停止SmartConfig服务
     if (sc_event_instance_) {
@@ -923,14 +1354,23 @@ void WifiConfigurationAp::Stop() {
     esp_smartconfig_stop();
 #endif
 
-    // 停止定时器
+    // 等待进行中的连接任务结束
+    StopConnectJob();
+
+    // 关闭事件流（扫描、固件上传）
+    if (scan_listener_ != 0) {
+        WifiScanService::GetInstance().RemoveListener(scan_listener_);
+        scan_listener_ = 0;
+    }
     if (scan_timer_) {
         esp_timer_stop(scan_timer_);
         esp_timer_delete(scan_timer_);
         scan_timer_ = nullptr;
     }
+    CloseEventStreams();
 
-    // 停止Web服务器
+    // 停止Web服务器（先让工作线程处理完已排队的请求）
+    workers_.Stop();
     if (server_) {
         httpd_stop(server_);
         server_ = nullptr;
@@ -942,7 +1382,22 @@ void WifiConfigurationAp::Stop() {
         dns_server_.reset();
     }
 
-    // 注销事件处理器
+    // 注销事件处理器并销毁网络接口（借用的接口保留）
+    ReleaseInterface();
+
+    // 停止WiFi（但不 deinit，WiFi 驱动由 WifiManager 管理）
+    esp_wifi_scan_stop();
+    if (keep_driver) {
+        // Drop only the AP interface, a running station keeps its association
+        esp_wifi_set_mode(WIFI_MODE_STA);
+    } else {
+        esp_wifi_stop();
+    }
+
+    ESP_LOGI(TAG, "Wifi configuration AP stopped");
+}
+
+void WifiConfigurationAp::ReleaseInterface() {
     if (instance_any_id_) {
         esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id_);
         instance_any_id_ = nullptr;
@@ -951,15 +1406,23 @@ void WifiConfigurationAp::Stop() {
         esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip_);
         instance_got_ip_ = nullptr;
     }
-
-    // 停止WiFi（但不 deinit，WiFi 驱动由 WifiManager 管理）
-    esp_wifi_stop();
-    
-    // 销毁网络接口
-    if (ap_netif_) {
+    if (ap_netif_ && owns_netif_) {
         esp_netif_destroy_default_wifi(ap_netif_);
-        ap_netif_ = nullptr;
     }
+    ap_netif_ = nullptr;
+    owns_netif_ = false;
+}
 
-    ESP_LOGI(TAG, "Wifi configuration AP stopped");
+esp_netif_t* WifiConfigurationAp::CreateNetif()
+{
+    // Router address 192.168.4.1, kept by the netif across AP restarts
+    esp_netif_t* netif = esp_netif_create_default_wifi_ap();
+    esp_netif_ip_info_t ip_info;
+    IP4_ADDR(&ip_info.ip, 192, 168, 4, 1);
+    IP4_ADDR(&ip_info.gw, 192, 168, 4, 1);
+    IP4_ADDR(&ip_info.netmask, 255, 255, 255, 0);
+    esp_netif_dhcps_stop(netif);
+    esp_netif_set_ip_info(netif, &ip_info);
+    esp_netif_dhcps_start(netif);
+    return netif;
 }
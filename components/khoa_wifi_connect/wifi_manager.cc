@@ -5,16 +5,25 @@
 #include "wifi_manager.h"
 #include "wifi_station.h"
 #include "wifi_configuration_ap.h"
+#include "wifi_config_store.h"
+#include "wifi_scan_service.h"
 
+#include <cstring>
+#include <algorithm>
+#include <cinttypes>
 #include <esp_log.h>
 #include <esp_wifi.h>
 #include <esp_netif.h>
 #include <esp_event.h>
 #include <esp_mac.h>
+#include <esp_system.h>
+#include <esp_timer.h>
 #include <nvs_flash.h>
 
 #define TAG "WifiManager"
 
+ESP_EVENT_DEFINE_BASE(WIFI_MANAGER_EVENT);
+
 WifiManager& WifiManager::GetInstance() {
     static WifiManager instance;
     return instance;
@@ -23,30 +32,71 @@ WifiManager& WifiManager::GetInstance() {
 WifiManager::WifiManager() = default;
 
 WifiManager::~WifiManager() {
+    if (config_subscriber_id_) {
+        WifiConfigStore::GetInstance().Unsubscribe(config_subscriber_id_);
+    }
+    if (worker_task_) {
+        vTaskDelete(worker_task_);
+    }
+    if (command_queue_) {
+        vQueueDelete(command_queue_);
+    }
+    // The portal goes first and outside mutex_: its connect job may still call
+    // back into the station control
+    if (config_mode_active_ && config_ap_) {
+        config_ap_->Stop();
+    }
+    config_ap_.reset();
     std::lock_guard<std::mutex> lock(mutex_);
     if (station_active_ && station_) {
         station_->Stop();
     }
-    if (config_mode_active_ && config_ap_) {
-        config_ap_->Stop();
+    if (ap_netif_) {
+        esp_netif_destroy_default_wifi(ap_netif_);
     }
+    WifiScanService::GetInstance().Stop();
     if (initialized_) {
         esp_wifi_deinit();
     }
+    if (event_loop_) {
+        esp_event_loop_delete(event_loop_);
+    }
 }
 
 void WifiManager::NotifyEvent(WifiEvent event) {
-    // Copy callback under lock, invoke without lock to avoid deadlock
-    std::function<void(WifiEvent)> callback;
+    WifiEventInfo info = {};
+    info.event = event;
+    Publish(info);
+}
+
+void WifiManager::Publish(const WifiEventInfo& info) {
+    if (event_loop_) {
+        // The loop copies the payload, subscribers run on its task
+        esp_err_t err = esp_event_post_to(event_loop_, WIFI_MANAGER_EVENT, (int32_t)info.event,
+                                          &info, sizeof(info), pdMS_TO_TICKS(100));
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Dropped event %d: %s", (int)info.event, esp_err_to_name(err));
+        }
+        return;
+    }
+    Dispatch(info);
+}
+
+void WifiManager::Dispatch(const WifiEventInfo& info) {
+    std::shared_ptr<const SubscriberList> subscribers;
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        callback = event_callback_;
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        subscribers = subscribers_;
     }
-    if (callback) {
-        callback(event);
+    for (const auto& subscriber : *subscribers) {
+        subscriber.handler(info);
     }
 }
 
+void WifiManager::EventLoopHandler(void* arg, esp_event_base_t base, int32_t id, void* data) {
+    static_cast<WifiManager*>(arg)->Dispatch(*static_cast<const WifiEventInfo*>(data));
+}
+
 bool WifiManager::Initialize(const WifiManagerConfig& config) {
     std::lock_guard<std::mutex> lock(mutex_);
     
@@ -70,6 +120,18 @@ bool WifiManager::Initialize(const WifiManagerConfig& config) {
         return false;
     }
 
+    // Single NVS read of the advanced settings; later reads are served from RAM
+    auto& store = WifiConfigStore::GetInstance();
+    store.Load();
+    config_subscriber_id_ = store.Subscribe([this](const WifiAdvancedConfig& old_config,
+                                                   const WifiAdvancedConfig& new_config) {
+        if (old_config.sleep_mode != new_config.sleep_mode) {
+            std::lock_guard<std::mutex> power_lock(power_mutex_);
+            idle_power_save_ = new_config.sleep_mode ? config_.idle_power_save : WifiPowerSaveLevel::PERFORMANCE;
+            ApplyPowerSaveLocked();
+        }
+    });
+
     // Initialize netif
     ret = esp_netif_init();
     if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
@@ -92,9 +154,38 @@ bool WifiManager::Initialize(const WifiManagerConfig& config) {
         ESP_LOGE(TAG, "WiFi init failed: %s", esp_err_to_name(ret));
         return false;
     }
+    // Station and config portal share one scan schedule and result cache
+    WifiScanService::GetInstance().Start();
+
+    if (config_.dedicated_event_loop) {
+        esp_event_loop_args_t loop_args = {
+            .queue_size = 16,
+            .task_name = "wifi_mgr_evt",
+            .task_priority = (UBaseType_t)config_.event_task_priority,
+            .task_stack_size = (uint32_t)config_.event_task_stack_size,
+            .task_core_id = tskNO_AFFINITY
+        };
+        ret = esp_event_loop_create(&loop_args, &event_loop_);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Event bus loop create failed: %s", esp_err_to_name(ret));
+            return false;
+        }
+        ESP_ERROR_CHECK(esp_event_handler_register_with(event_loop_, WIFI_MANAGER_EVENT, ESP_EVENT_ANY_ID,
+                                                        &WifiManager::EventLoopHandler, this));
+    }
 
+    // The config AP is created per session by DoStartConfigAp()
     station_ = std::make_unique<WifiStation>();
-    config_ap_ = std::make_unique<WifiConfigurationAp>();
+    station_->SetWarmSwitch(config_.warm_mode_switch);
+
+    // Mode transitions run on one worker; the public methods only enqueue
+    command_queue_ = xQueueCreate(config_.command_queue_length, sizeof(CommandMessage));
+    if (command_queue_ == nullptr ||
+        xTaskCreate(&WifiManager::WorkerTask, "wifi_mgr", config_.worker_task_stack_size, this,
+                    config_.worker_task_priority, &worker_task_) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the command worker");
+        return false;
+    }
 
     initialized_ = true;
     ESP_LOGI(TAG, "Initialized");
@@ -106,15 +197,74 @@ bool WifiManager::IsInitialized() const {
     return initialized_;
 }
 
-// ==================== Station Mode ====================
+// ==================== Command Mailbox ====================
 
-void WifiManager::StartStation() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    if (!initialized_) {
+std::future<void> WifiManager::Post(Command command) {
+    auto* done = new std::promise<void>();
+    auto future = done->get_future();
+
+    CommandMessage message = {command, done};
+    if (command_queue_ == nullptr) {
         ESP_LOGE(TAG, "Not initialized");
-        return;
+    } else if (xQueueSend(command_queue_, &message, 0) == pdTRUE) {
+        return future;
+    } else {
+        ESP_LOGE(TAG, "Command queue full, dropping command %d", (int)command);
     }
+    done->set_value();
+    delete done;
+    return future;
+}
+
+void WifiManager::WorkerTask(void* arg) {
+    auto* this_ = static_cast<WifiManager*>(arg);
+    CommandMessage message;
+    while (xQueueReceive(this_->command_queue_, &message, portMAX_DELAY) == pdTRUE) {
+        int64_t start_us = esp_timer_get_time();
+        bool switched = false;
+        switch (message.command) {
+            case Command::StartStation:
+                switched = !this_->station_active_;
+                this_->DoStartStation();
+                break;
+            case Command::StopStation:
+                this_->DoStopStation();
+                break;
+            case Command::StartConfigAp:
+                switched = !this_->config_mode_active_;
+                this_->DoStartConfigAp();
+                break;
+            case Command::StopConfigAp:
+                this_->DoStopConfigAp();
+                break;
+        }
+        uint32_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+        if (switched) {
+            this_->metrics_.RecordModeSwitch(elapsed_ms);
+            ESP_LOGI(TAG, "Switched to %s in %" PRIu32 " ms (%s)",
+                     message.command == Command::StartStation ? "station" : "config AP",
+                     elapsed_ms, this_->config_.warm_mode_switch ? "warm" : "cold");
+        } else {
+            ESP_LOGD(TAG, "Command %d done in %" PRIu32 " ms", (int)message.command, elapsed_ms);
+        }
+        if (message.done) {
+            message.done->set_value();
+            delete message.done;
+        }
+    }
+}
+
+// ==================== Station Mode ====================
+
+std::future<void> WifiManager::StartStation() {
+    return Post(Command::StartStation);
+}
+
+std::future<void> WifiManager::StopStation() {
+    return Post(Command::StopStation);
+}
+
+void WifiManager::DoStartStation() {
     if (station_active_) {
         ESP_LOGW(TAG, "Station already active");
         return;
@@ -123,53 +273,84 @@ void WifiManager::StartStation() {
     // Auto-stop config AP if active
     if (config_mode_active_) {
         ESP_LOGI(TAG, "Stopping config AP before starting station");
-        config_ap_->Stop();
-        config_mode_active_ = false;
-        // Notify outside lock
-        mutex_.unlock();
-        NotifyEvent(WifiEvent::ConfigModeExit);
-        mutex_.lock();
+        DoStopConfigAp(config_.warm_mode_switch);
     }
 
     ESP_LOGI(TAG, "Starting station");
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
 
-    // Apply configuration
-    station_->SetScanIntervalRange(config_.station_scan_min_interval_seconds,
-                                   config_.station_scan_max_interval_seconds);
-
-    // Setup callbacks
-    station_->OnScanBegin([this]() {
-        NotifyEvent(WifiEvent::Scanning);
-    });
-    station_->OnConnect([this](const std::string&) {
-        NotifyEvent(WifiEvent::Connecting);
-    });
-    station_->OnConnected([this](const std::string&) {
-        NotifyEvent(WifiEvent::Connected);
-    });
-    station_->OnDisconnected([this]() {
-        NotifyEvent(WifiEvent::Disconnected);
-    });
+        // Apply configuration
+        station_->SetScanIntervalRange(config_.station_scan_min_interval_seconds,
+                                       config_.station_scan_max_interval_seconds);
+        station_->SetListenInterval(config_.idle_listen_interval);
+        station_->SetFastReconnect(config_.fast_reconnect);
+        station_->SetSelectionPolicy(config_.ap_selection);
+        {
+            std::lock_guard<std::mutex> power_lock(power_mutex_);
+            idle_power_save_ = WifiConfigStore::GetInstance().GetSleepMode() ? config_.idle_power_save
+                                                                             : WifiPowerSaveLevel::PERFORMANCE;
+        }
+
+        // Setup callbacks
+        station_->OnScanBegin([this]() {
+            NotifyEvent(WifiEvent::Scanning);
+        });
+        station_->OnConnect([this](const SsidString& ssid) {
+            WifiEventInfo info = {};
+            info.event = WifiEvent::Connecting;
+            strlcpy(info.ssid, ssid.c_str(), sizeof(info.ssid));
+            Publish(info);
+        });
+        station_->OnConnected([this](const SsidString& ssid) {
+            SetLinkUp(true);
+            WifiEventInfo info = {};
+            info.event = WifiEvent::Connected;
+            strlcpy(info.ssid, ssid.c_str(), sizeof(info.ssid));
+            strlcpy(info.ip_address, station_->GetIpAddress().c_str(), sizeof(info.ip_address));
+            info.rssi = station_->GetRssi();
+            info.channel = station_->GetChannel();
+            Publish(info);
+        });
+        station_->OnDisconnected([this](uint8_t reason) {
+            SetLinkUp(false);
+            metrics_.RecordDisconnect(reason);
+            WifiEventInfo info = {};
+            info.event = WifiEvent::Disconnected;
+            strlcpy(info.ssid, station_->GetSsid().c_str(), sizeof(info.ssid));
+            info.disconnect_reason = reason;
+            Publish(info);
+        });
+        station_->OnAttemptFinished([this](const WifiConnectAttempt& attempt) {
+            metrics_.RecordAttempt(attempt);
+        });
+    }
 
-    station_->Start();
+    // Outside mutex_: on a warm switch Start() begins the scan and publishes
+    // Scanning from this task
+    station_->Start(driver_running_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    driver_running_ = true;
     station_active_ = true;
 }
 
-void WifiManager::StopStation() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
+void WifiManager::DoStopStation(bool keep_driver) {
     if (!station_active_) {
         return;
     }
 
     ESP_LOGI(TAG, "Stopping station");
-    station_->Stop();
+    SetLinkUp(false);
+    // A concurrent config AP keeps the driver running
+    keep_driver = keep_driver || config_mode_active_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        station_->Stop(keep_driver);
+        station_active_ = false;
+        driver_running_ = keep_driver;
+    }
     ESP_LOGI(TAG, "Station stopped");
-    station_active_ = false;
-    
-    mutex_.unlock();
     NotifyEvent(WifiEvent::Disconnected);
-    mutex_.lock();
 }
 
 bool WifiManager::IsConnected() const {
@@ -177,15 +358,15 @@ bool WifiManager::IsConnected() const {
     return station_active_ && station_ && station_->IsConnected();
 }
 
-std::string WifiManager::GetSsid() const {
+SsidString WifiManager::GetSsid() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    if (!station_active_ || !station_) return "";
+    if (!station_active_ || !station_) return SsidString();
     return station_->GetSsid();
 }
 
-std::string WifiManager::GetIpAddress() const {
+IpAddressString WifiManager::GetIpAddress() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    if (!station_active_ || !station_) return "";
+    if (!station_active_ || !station_) return IpAddressString();
     return station_->GetIpAddress();
 }
 
@@ -201,7 +382,7 @@ int WifiManager::GetChannel() const {
     return station_->GetChannel();
 }
 
-std::string WifiManager::GetMacAddress() const {
+MacAddressString WifiManager::GetMacAddress() const {
     std::lock_guard<std::mutex> lock(mutex_);
     if (!mac_address_.empty()) {
         return mac_address_;
@@ -217,63 +398,129 @@ std::string WifiManager::GetMacAddress() const {
     return mac_address_;
 }
 
+// ==================== Diagnostics ====================
+
+WifiConnectionStats WifiManager::GetConnectionStats() const {
+    return metrics_.GetStats();
+}
+
+std::vector<WifiConnectAttempt> WifiManager::GetConnectionHistory() const {
+    return metrics_.GetRecentAttempts();
+}
+
+void WifiManager::ResetConnectionStats() {
+    metrics_.Reset();
+}
+
 // ==================== Config AP Mode ====================
 
-void WifiManager::StartConfigAp() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    if (!initialized_) {
-        ESP_LOGE(TAG, "Not initialized");
-        return;
-    }
+std::future<void> WifiManager::StartConfigAp() {
+    return Post(Command::StartConfigAp);
+}
+
+std::future<void> WifiManager::StopConfigAp() {
+    return Post(Command::StopConfigAp);
+}
+
+void WifiManager::DoStartConfigAp() {
     if (config_mode_active_) {
         ESP_LOGW(TAG, "Config AP already active");
         return;
     }
 
-    // Auto-stop station if active
-    if (station_active_) {
+    // Auto-stop station if active, unless it keeps serving alongside the portal
+    if (station_active_ && !config_.concurrent_config_ap) {
         ESP_LOGI(TAG, "Stopping station before starting config AP");
-        station_->Stop();
-        station_active_ = false;
-        mutex_.unlock();
-        NotifyEvent(WifiEvent::Disconnected);
-        mutex_.lock();
+        DoStopStation(config_.warm_mode_switch);
     }
+    SetApRunning(true);
 
-    ESP_LOGI(TAG, "Starting config AP");
+    // Warm switching keeps the AP netif for the process lifetime; everything else
+    // belongs to the session and is freed when it ends
+    if (config_.warm_mode_switch && ap_netif_ == nullptr) {
+        ap_netif_ = WifiConfigurationAp::CreateNetif();
+    }
+    portal_heap_baseline_ = esp_get_free_heap_size();
 
-    config_ap_->SetSsidPrefix(config_.ssid_prefix);
-    config_ap_->SetLanguage(config_.language);
-    
-    // Web handler calls this when user submits config
-    config_ap_->OnExitRequested([this]() {
+    ESP_LOGI(TAG, "Starting config AP, free heap %" PRIu32, portal_heap_baseline_);
+
+    // Built and started outside mutex_: Start() may survey channels (a blocking
+    // scan of several seconds) and the getters must not stall behind it
+    auto config_ap = std::make_unique<WifiConfigurationAp>();
+    if (ap_netif_) {
+        config_ap->SetNetif(ap_netif_);
+    }
+    config_ap->SetSsidPrefix(config_.ssid_prefix);
+    config_ap->SetLanguage(config_.language);
+    config_ap->SetSelectionPolicy(config_.ap_selection);
+    config_ap->SetFirmwareUpload(config_.firmware_upload);
+    config_ap->SetChannelSurvey(config_.ap_channel_survey);
+
+    // Web handler calls this when user submits config; only enqueues, so it
+    // returns before the portal (and the handler's own task) is torn down
+    config_ap->OnExitRequested([this]() {
         ESP_LOGI(TAG, "Config exit requested from web");
         StopConfigAp();
     });
-    
-    config_ap_->Start();
-    config_mode_active_ = true;
+    // Runs on the httpd task; the station callbacks publish events, so no mutex_
+    config_ap->SetStationControl([this](bool suspend) {
+        bool station_active;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            station_active = station_active_;
+        }
+        if (!station_active) {
+            return;
+        }
+        if (suspend) {
+            station_->Suspend();
+        } else {
+            station_->Resume();
+        }
+    });
 
-    mutex_.unlock();
-    NotifyEvent(WifiEvent::ConfigModeEnter);
-    mutex_.lock();
+    // driver_running_ is only written by this worker, so reading it unlocked is safe
+    config_ap->Start(driver_running_);
+
+    WifiEventInfo info = {};
+    info.event = WifiEvent::ConfigModeEnter;
+    strlcpy(info.ssid, config_ap->GetSsid().c_str(), sizeof(info.ssid));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        config_ap_ = std::move(config_ap);
+        driver_running_ = true;
+        config_mode_active_ = true;
+    }
+    Publish(info);
 }
 
-void WifiManager::StopConfigAp() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
+void WifiManager::DoStopConfigAp(bool keep_driver) {
     if (!config_mode_active_) {
         return;
     }
 
     ESP_LOGI(TAG, "Stopping config AP");
-    config_ap_->Stop();
-    config_mode_active_ = false;
-
-    mutex_.unlock();
+    // A concurrent station keeps the driver running
+    keep_driver = keep_driver || station_active_;
+    std::unique_ptr<WifiConfigurationAp> config_ap;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        config_ap = std::move(config_ap_);
+        config_mode_active_ = false;
+        driver_running_ = keep_driver;
+    }
+    // Outside mutex_: Stop() joins the portal's connect job and HTTP workers,
+    // which call back into the station control
+    config_ap->Stop(keep_driver);
+    config_ap.reset();
+    WifiScanService::GetInstance().Clear();
+    SetApRunning(false);
+    // Task stacks of the portal (DNS, exit helper) are freed by the idle task a
+    // moment later, so a small negative delta right here is expected
+    uint32_t free_heap = esp_get_free_heap_size();
+    ESP_LOGI(TAG, "Config AP released, free heap %" PRIu32 " (%+" PRId32 " bytes vs. session start)",
+             free_heap, (int32_t)(free_heap - portal_heap_baseline_));
     NotifyEvent(WifiEvent::ConfigModeExit);
-    mutex_.lock();
 }
 
 bool WifiManager::IsConfigMode() const {
@@ -281,9 +528,9 @@ bool WifiManager::IsConfigMode() const {
     return config_mode_active_;
 }
 
-std::string WifiManager::GetApSsid() const {
+SsidString WifiManager::GetApSsid() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    if (!config_mode_active_ || !config_ap_) return "";
+    if (!config_mode_active_ || !config_ap_) return SsidString();
     return config_ap_->GetSsid();
 }
 
@@ -293,49 +540,114 @@ std::string WifiManager::GetApWebUrl() const {
     return config_ap_->GetWebServerUrl();
 }
 
+ApChannelChoice WifiManager::GetApChannel() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!config_mode_active_ || !config_ap_) return ApChannelChoice();
+    return config_ap_->GetChannel();
+}
+
 // ==================== Power ====================
 
 void WifiManager::SetPowerSaveLevel(WifiPowerSaveLevel level) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (!station_active_ || !station_) {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    idle_power_save_ = level;
+    ApplyPowerSaveLocked();
+}
+
+void WifiManager::BeginTransfer() {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    active_transfers_++;
+    ApplyPowerSaveLocked();
+}
+
+void WifiManager::EndTransfer() {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    if (active_transfers_ > 0) {
+        active_transfers_--;
+    }
+    ApplyPowerSaveLocked();
+}
+
+void WifiManager::SetLinkUp(bool up) {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    link_up_ = up;
+    // The driver keeps its power save mode across reconnects but the config AP
+    // forces WIFI_PS_NONE, so re-apply on every new link
+    power_save_applied_ = false;
+    ApplyPowerSaveLocked();
+}
+
+void WifiManager::SetApRunning(bool running) {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    ap_running_ = running;
+    // StartAccessPoint() forces WIFI_PS_NONE itself; re-apply once the AP is gone
+    power_save_applied_ = false;
+    ApplyPowerSaveLocked();
+}
+
+void WifiManager::ApplyPowerSaveLocked() {
+    if (!link_up_ || !station_) {
+        return;
+    }
+    auto level = (active_transfers_ > 0 || ap_running_) ? WifiPowerSaveLevel::PERFORMANCE : idle_power_save_;
+    if (power_save_applied_ && level == applied_power_save_) {
         return;
     }
     station_->SetPowerSaveLevel(level);
+    applied_power_save_ = level;
+    power_save_applied_ = true;
 }
 
 // ==================== Configuration Getters ====================
 
-static std::string nvs_read_string(const char* key, const char* default_val = "") {
-    nvs_handle_t nvs;
-    if (nvs_open("wifi", NVS_READONLY, &nvs) != ESP_OK) {
-        return default_val;
-    }
-    char buf[256] = {0};
-    size_t size = sizeof(buf);
-    esp_err_t err = nvs_get_str(nvs, key, buf, &size);
-    nvs_close(nvs);
-    return (err == ESP_OK) ? std::string(buf) : default_val;
+FixedString<15> WifiManager::GetViboKey() const {
+    return WifiConfigStore::GetInstance().GetViboKey();
 }
 
-std::string WifiManager::GetViboKey() const {
-    return nvs_read_string("vibo_key");
+UrlString WifiManager::GetGoogleSheetUrl1() const {
+    return WifiConfigStore::GetInstance().GetGoogleSheetUrl1();
 }
 
-std::string WifiManager::GetGoogleSheetUrl1() const {
-    return nvs_read_string("gs_url");
+UrlString WifiManager::GetGoogleSheetUrl2() const {
+    return WifiConfigStore::GetInstance().GetGoogleSheetUrl2();
 }
 
-std::string WifiManager::GetGoogleSheetUrl2() const {
-    return nvs_read_string("gs_url_2");
+UrlString WifiManager::GetOtaUrl() const {
+    return WifiConfigStore::GetInstance().GetOtaUrl();
 }
 
-std::string WifiManager::GetOtaUrl() const {
-    return nvs_read_string("ota_url");
+// ==================== Event ====================
+
+int WifiManager::Subscribe(WifiEventHandler handler) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    auto list = std::make_shared<SubscriberList>(*subscribers_);
+    int id = next_subscriber_id_++;
+    list->push_back({id, std::move(handler)});
+    subscribers_ = std::move(list);
+    return id;
 }
 
-// ==================== Event ====================
+void WifiManager::Unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    auto list = std::make_shared<SubscriberList>(*subscribers_);
+    list->erase(std::remove_if(list->begin(), list->end(), [id](const Subscriber& s) {
+        return s.id == id;
+    }), list->end());
+    subscribers_ = std::move(list);
+}
 
 void WifiManager::SetEventCallback(std::function<void(WifiEvent)> callback) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    event_callback_ = std::move(callback);
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    auto list = std::make_shared<SubscriberList>(*subscribers_);
+    list->erase(std::remove_if(list->begin(), list->end(), [this](const Subscriber& s) {
+        return s.id == callback_subscriber_id_;
+    }), list->end());
+    callback_subscriber_id_ = 0;
+    if (callback) {
+        callback_subscriber_id_ = next_subscriber_id_++;
+        list->push_back({callback_subscriber_id_, [callback = std::move(callback)](const WifiEventInfo& info) {
+            callback(info.event);
+        }});
+    }
+    subscribers_ = std::move(list);
 }
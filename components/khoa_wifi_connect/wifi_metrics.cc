@@ -0,0 +1,124 @@
+#include "wifi_metrics.h"
+
+#include <algorithm>
+#include <esp_timer.h>
+
+void WifiMetrics::RecordAttempt(const WifiConnectAttempt& attempt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ring_[head_] = attempt;
+    head_ = (head_ + 1) % kCapacity;
+    size_ = std::min(size_ + 1, kCapacity);
+
+    stats_.attempts++;
+    if (attempt.reconnects > 0) {
+        stats_.reconnects++;
+    }
+    if (attempt.scan_ms > 0) {
+        total_scan_ms_ += attempt.scan_ms;
+        scan_samples_++;
+    }
+    if (attempt.assoc_ms > 0) {
+        total_assoc_ms_ += attempt.assoc_ms;
+        assoc_samples_++;
+    }
+
+    if (attempt.success && attempt.assoc_ms > 0) {
+        if (attempt.cached_credentials) {
+            stats_.cache_hits++;
+            total_cached_handshake_ms_ += attempt.assoc_ms;
+            if (full_handshake_samples_ > 0) {
+                uint32_t full_ms = total_full_handshake_ms_ / full_handshake_samples_;
+                if (full_ms > attempt.assoc_ms) {
+                    stats_.handshake_saved_ms += full_ms - attempt.assoc_ms;
+                }
+            }
+        } else {
+            total_full_handshake_ms_ += attempt.assoc_ms;
+            full_handshake_samples_++;
+        }
+    }
+
+    if (attempt.success) {
+        stats_.successes++;
+        total_dhcp_ms_ += attempt.dhcp_ms;
+        stats_.max_connect_ms = std::max(stats_.max_connect_ms, attempt.assoc_ms + attempt.dhcp_ms);
+        stats_.last_connected_us = attempt.timestamp_us + (int64_t)(attempt.assoc_ms + attempt.dhcp_ms) * 1000;
+    } else {
+        stats_.failures++;
+        CountReason(attempt.disconnect_reason);
+    }
+}
+
+void WifiMetrics::RecordDisconnect(uint8_t reason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.disconnects++;
+    stats_.last_disconnected_us = esp_timer_get_time();
+    CountReason(reason);
+}
+
+void WifiMetrics::RecordModeSwitch(uint32_t duration_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.mode_switches++;
+    stats_.last_switch_ms = duration_ms;
+    stats_.max_switch_ms = std::max(stats_.max_switch_ms, duration_ms);
+    total_switch_ms_ += duration_ms;
+}
+
+void WifiMetrics::CountReason(uint8_t reason) {
+    stats_.last_disconnect_reason = reason;
+    for (int i = 0; i < stats_.reason_count; i++) {
+        if (stats_.reasons[i].reason == reason) {
+            if (stats_.reasons[i].count < UINT16_MAX) {
+                stats_.reasons[i].count++;
+            }
+            return;
+        }
+    }
+    if (stats_.reason_count < WifiConnectionStats::kMaxReasons) {
+        stats_.reasons[stats_.reason_count++] = {reason, 1};
+        return;
+    }
+    // Table full: replace the least frequent reason
+    auto* least = std::min_element(stats_.reasons, stats_.reasons + WifiConnectionStats::kMaxReasons,
+        [](const auto& a, const auto& b) { return a.count < b.count; });
+    *least = {reason, 1};
+}
+
+WifiConnectionStats WifiMetrics::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    WifiConnectionStats stats = stats_;
+    stats.avg_scan_ms = scan_samples_ ? total_scan_ms_ / scan_samples_ : 0;
+    stats.avg_assoc_ms = assoc_samples_ ? total_assoc_ms_ / assoc_samples_ : 0;
+    stats.avg_dhcp_ms = stats_.successes ? total_dhcp_ms_ / stats_.successes : 0;
+    stats.full_handshake_ms = full_handshake_samples_ ? total_full_handshake_ms_ / full_handshake_samples_ : 0;
+    stats.cached_handshake_ms = stats_.cache_hits ? total_cached_handshake_ms_ / stats_.cache_hits : 0;
+    stats.avg_switch_ms = stats_.mode_switches ? total_switch_ms_ / stats_.mode_switches : 0;
+    return stats;
+}
+
+std::vector<WifiConnectAttempt> WifiMetrics::GetRecentAttempts() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<WifiConnectAttempt> attempts;
+    attempts.reserve(size_);
+    int start = (head_ - size_ + kCapacity) % kCapacity;
+    for (int i = 0; i < size_; i++) {
+        attempts.push_back(ring_[(start + i) % kCapacity]);
+    }
+    return attempts;
+}
+
+void WifiMetrics::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    head_ = 0;
+    size_ = 0;
+    stats_ = {};
+    total_scan_ms_ = 0;
+    scan_samples_ = 0;
+    total_assoc_ms_ = 0;
+    assoc_samples_ = 0;
+    total_dhcp_ms_ = 0;
+    total_full_handshake_ms_ = 0;
+    full_handshake_samples_ = 0;
+    total_cached_handshake_ms_ = 0;
+    total_switch_ms_ = 0;
+}
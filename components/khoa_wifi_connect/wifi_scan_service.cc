@@ -0,0 +1,129 @@
+#include "wifi_scan_service.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+
+#define TAG "WifiScanService"
+
+int WifiScanResult::AgeMs() const {
+    return (esp_timer_get_time() - timestamp_us) / 1000;
+}
+
+void WifiScanService::Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (instance_scan_done_ != nullptr) {
+        return;
+    }
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        WIFI_EVENT_SCAN_DONE,
+                                                        &WifiScanService::ScanDoneHandler,
+                                                        this,
+                                                        &instance_scan_done_));
+}
+
+void WifiScanService::Stop() {
+    std::vector<ScanCallback> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (instance_scan_done_ != nullptr) {
+            esp_event_handler_instance_unregister(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, instance_scan_done_);
+            instance_scan_done_ = nullptr;
+        }
+        scanning_ = false;
+        waiters.swap(waiters_);
+        results_.reset();
+    }
+    for (const auto& waiter : waiters) {
+        waiter(nullptr);
+    }
+}
+
+bool WifiScanService::RequestScan(ScanCallback done) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!scanning_) {
+        esp_err_t err = esp_wifi_scan_start(nullptr, false);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Scan not started: %s", esp_err_to_name(err));
+            return false;
+        }
+        scanning_ = true;
+    }
+    if (done) {
+        waiters_.push_back(std::move(done));
+    }
+    return true;
+}
+
+bool WifiScanService::IsScanning() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scanning_;
+}
+
+WifiScanService::Snapshot WifiScanService::GetResults() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return results_;
+}
+
+void WifiScanService::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    results_.reset();
+}
+
+int WifiScanService::AddListener(ScanCallback listener) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    int id = next_listener_id_++;
+    listeners_.emplace_back(id, std::move(listener));
+    return id;
+}
+
+void WifiScanService::RemoveListener(int id) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    for (auto it = listeners_.begin(); it != listeners_.end(); ++it) {
+        if (it->first == id) {
+            listeners_.erase(it);
+            return;
+        }
+    }
+}
+
+void WifiScanService::ScanDoneHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    auto* this_ = static_cast<WifiScanService*>(arg);
+    auto* event = static_cast<wifi_event_sta_scan_done_t*>(event_data);
+
+    // Fetch outside the lock; this also frees the driver's copy of the records
+    Snapshot results;
+    if (event->status == 0) {
+        auto result = std::make_shared<WifiScanResult>();
+        uint16_t ap_num = 0;
+        esp_wifi_scan_get_ap_num(&ap_num);
+        result->records.resize(ap_num);
+        esp_wifi_scan_get_ap_records(&ap_num, result->records.data());
+        result->records.resize(ap_num);
+        result->timestamp_us = esp_timer_get_time();
+        results = std::move(result);
+    } else {
+        esp_wifi_clear_ap_list();
+    }
+
+    std::vector<ScanCallback> waiters;
+    {
+        std::lock_guard<std::mutex> lock(this_->mutex_);
+        this_->scanning_ = false;
+        if (results) {
+            this_->results_ = results;
+        }
+        waiters.swap(this_->waiters_);
+    }
+    ESP_LOGD(TAG, "Scan done, %d APs, %d waiters", results ? (int)results->records.size() : -1, (int)waiters.size());
+    for (const auto& waiter : waiters) {
+        waiter(results);
+    }
+
+    if (results) {
+        std::lock_guard<std::mutex> lock(this_->listeners_mutex_);
+        for (const auto& listener : this_->listeners_) {
+            listener.second(results);
+        }
+    }
+}
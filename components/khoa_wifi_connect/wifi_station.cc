@@ -11,32 +11,37 @@
 #include <esp_netif.h>
 #include <esp_system.h>
 #include "ssid_manager.h"
+#include "ap_history.h"
+#include "wifi_config_store.h"
+#include "wifi_scan_service.h"
+#include "sdkconfig.h"
 
 #define TAG "WifiStation"
 #define WIFI_EVENT_CONNECTED BIT0
 #define WIFI_EVENT_STOPPED BIT1
 #define WIFI_EVENT_SCAN_DONE_BIT BIT2
+#define WIFI_EVENT_SUSPENDED_BIT BIT3   // Disconnect requested by Suspend() reported by the driver
+#define SUSPEND_DISCONNECT_TIMEOUT_MS 1000
 #define MAX_RECONNECT_COUNT 5
+#define FAST_CONNECT_RETRY_COUNT 1   // Persisted last AP gets one retry before falling back to a scan
+
+// Resume() is finished on the default event loop, behind the events the borrower caused
+ESP_EVENT_DEFINE_BASE(WIFI_STATION_EVENT);
+#define WIFI_STATION_EVENT_RESUME 0
 
 WifiStation::WifiStation() {
     // Create the event group
     event_group_ = xEventGroupCreate();
 
-    // 读取配置
+    // Last good AP for fast connect; the advanced settings come from WifiConfigStore
     nvs_handle_t nvs;
     esp_err_t err = nvs_open("wifi", NVS_READONLY, &nvs);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to open NVS: %d", err);
-        max_tx_power_ = 0;
-        remember_bssid_ = 0;
     } else {
-        err = nvs_get_i8(nvs, "max_tx_power", &max_tx_power_);
-        if (err != ESP_OK) {
-            max_tx_power_ = 0;
-        }
-        err = nvs_get_u8(nvs, "remember_bssid", &remember_bssid_);
-        if (err != ESP_OK) {
-            remember_bssid_ = 0;
+        size_t length = sizeof(last_ap_);
+        if (nvs_get_blob(nvs, "last_ap", &last_ap_, &length) != ESP_OK || length != sizeof(last_ap_)) {
+            memset(&last_ap_, 0, sizeof(last_ap_));
         }
         nvs_close(nvs);
     }
@@ -44,6 +49,7 @@ WifiStation::WifiStation() {
 
 WifiStation::~WifiStation() {
     Stop();
+    ReleaseInterface();
     if (event_group_) {
         vEventGroupDelete(event_group_);
         event_group_ = nullptr;
@@ -55,17 +61,16 @@ void WifiStation::AddAuth(const std::string &&ssid, const std::string &&password
     ssid_manager.AddSsid(ssid, password);
 }
 
-void WifiStation::Stop() {
+void WifiStation::Stop(bool keep_driver) {
     ESP_LOGI(TAG, "Stopping WiFi station");
     
-    // Unregister event handlers FIRST to prevent scan done from triggering connect
-    if (instance_any_id_ != nullptr) {
-        esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id_);
-        instance_any_id_ = nullptr;
-    }
-    if (instance_got_ip_ != nullptr) {
-        esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip_);
-        instance_got_ip_ = nullptr;
+    // Silence event handlers FIRST to prevent scan done from triggering connect
+    active_ = false;
+    suspended_ = false;
+    scan_pending_ = false;
+    resume_pending_ = false;
+    if (!warm_switch_) {
+        ReleaseInterface();
     }
 
     // Stop timer
@@ -78,11 +83,8 @@ void WifiStation::Stop() {
     // Now safe to stop scan, disconnect and stop WiFi (no event callbacks will fire)
     esp_wifi_scan_stop();
     esp_wifi_disconnect();
-    esp_wifi_stop();
-
-    if (station_netif_ != nullptr) {
-        esp_netif_destroy_default_wifi(station_netif_);
-        station_netif_ = nullptr;
+    if (!keep_driver) {
+        esp_wifi_stop();
     }
     
     // Reset was_connected_ flag to prevent stale state from affecting subsequent sessions
@@ -96,23 +98,46 @@ void WifiStation::Stop() {
     xEventGroupSetBits(event_group_, WIFI_EVENT_STOPPED);
 }
 
+void WifiStation::ReleaseInterface() {
+    if (instance_any_id_ != nullptr) {
+        esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id_);
+        instance_any_id_ = nullptr;
+    }
+    if (instance_got_ip_ != nullptr) {
+        esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip_);
+        instance_got_ip_ = nullptr;
+    }
+    if (instance_resume_ != nullptr) {
+        esp_event_handler_instance_unregister(WIFI_STATION_EVENT, WIFI_STATION_EVENT_RESUME, instance_resume_);
+        instance_resume_ = nullptr;
+    }
+    if (station_netif_ != nullptr) {
+        esp_netif_destroy_default_wifi(station_netif_);
+        station_netif_ = nullptr;
+    }
+}
+
 void WifiStation::OnScanBegin(std::function<void()> on_scan_begin) {
     on_scan_begin_ = on_scan_begin;
 }
 
-void WifiStation::OnConnect(std::function<void(const std::string& ssid)> on_connect) {
+void WifiStation::OnConnect(std::function<void(const SsidString& ssid)> on_connect) {
     on_connect_ = on_connect;
 }
 
-void WifiStation::OnConnected(std::function<void(const std::string& ssid)> on_connected) {
+void WifiStation::OnConnected(std::function<void(const SsidString& ssid)> on_connected) {
     on_connected_ = on_connected;
 }
 
-void WifiStation::OnDisconnected(std::function<void()> on_disconnected) {
+void WifiStation::OnDisconnected(std::function<void(uint8_t reason)> on_disconnected) {
     on_disconnected_ = on_disconnected;
 }
 
-void WifiStation::Start() {
+void WifiStation::OnAttemptFinished(std::function<void(const WifiConnectAttempt& attempt)> on_attempt_finished) {
+    on_attempt_finished_ = on_attempt_finished;
+}
+
+void WifiStation::Start(bool driver_running) {
     // Note: esp_netif_init() and esp_wifi_init() should be called once before calling this method
     // WiFi driver is initialized by WifiManager::Initialize() and kept alive
     
@@ -120,30 +145,55 @@ void WifiStation::Start() {
     // Clear scan done bit so Stop() can wait for scan to complete
     xEventGroupClearBits(event_group_, WIFI_EVENT_STOPPED | WIFI_EVENT_SCAN_DONE_BIT);
     
-    // Create the default WiFi station interface
-    station_netif_ = esp_netif_create_default_wifi_sta();
-
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &WifiStation::WifiEventHandler,
-                                                        this,
-                                                        &instance_any_id_));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &WifiStation::IpEventHandler,
-                                                        this,
-                                                        &instance_got_ip_));
+    // Create the default WiFi station interface, kept from the last session in warm mode
+    if (station_netif_ == nullptr) {
+        station_netif_ = esp_netif_create_default_wifi_sta();
+    }
+    if (instance_any_id_ == nullptr) {
+        ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                            ESP_EVENT_ANY_ID,
+                                                            &WifiStation::WifiEventHandler,
+                                                            this,
+                                                            &instance_any_id_));
+        ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                            IP_EVENT_STA_GOT_IP,
+                                                            &WifiStation::IpEventHandler,
+                                                            this,
+                                                            &instance_got_ip_));
+        ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_STATION_EVENT,
+                                                            WIFI_STATION_EVENT_RESUME,
+                                                            &WifiStation::ResumeEventHandler,
+                                                            this,
+                                                            &instance_resume_));
+    }
+    active_ = true;
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_start());
+    int8_t tx_power;
+    if (driver_running && esp_wifi_get_max_tx_power(&tx_power) == ESP_ERR_WIFI_NOT_STARTED) {
+        // A warm switch must find the driver started, or no scan would ever run
+        ESP_LOGE(TAG, "Driver stopped before a warm switch, starting it");
+        driver_running = false;
+    }
+    if (!driver_running) {
+        ESP_ERROR_CHECK(esp_wifi_start());
+    }
+
+#ifdef CONFIG_SOC_WIFI_SUPPORT_5G
+    // Scan both bands so ApSelector can weigh 5 GHz BSSIDs
+    ESP_ERROR_CHECK(esp_wifi_set_band_mode(WIFI_BAND_MODE_AUTO));
+#endif
 
-    if (max_tx_power_ != 0) {
-        ESP_ERROR_CHECK(esp_wifi_set_max_tx_power(max_tx_power_));
+    auto& store = WifiConfigStore::GetInstance();
+    remember_bssid_ = store.GetRememberBssid();
+    int8_t max_tx_power = store.GetMaxTxPower();
+    if (max_tx_power != 0) {
+        ESP_ERROR_CHECK(esp_wifi_set_max_tx_power(max_tx_power));
     }
 
     // Setup the timer to scan WiFi
     esp_timer_create_args_t timer_args = {
         .callback = [](void* arg) {
-            esp_wifi_scan_start(nullptr, false);
+            static_cast<WifiStation*>(arg)->StartScan();
         },
         .arg = this,
         .dispatch_method = ESP_TIMER_TASK,
@@ -151,6 +201,99 @@ void WifiStation::Start() {
         .skip_unhandled_events = true
     };
     ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_handle_));
+
+    if (driver_running) {
+        // APSTA -> STA keeps the STA interface up, so no WIFI_EVENT_STA_START follows
+        OnStarted();
+    }
+}
+
+void WifiStation::OnStarted() {
+    if (TryFastConnect()) {
+        return;
+    }
+    StartScan();
+    if (on_scan_begin_) {
+        on_scan_begin_();
+    }
+}
+
+void WifiStation::StartScan() {
+    scan_start_us_ = esp_timer_get_time();
+    // Set before the request: SCAN_DONE may reach OnScanDone() before RequestScan() returns
+    scan_pending_ = true;
+    bool requested = WifiScanService::GetInstance().RequestScan([this](const WifiScanService::Snapshot& results) {
+        OnScanDone(results);
+    });
+    if (!requested) {
+        scan_pending_ = false;
+        // Another scan (config portal) or a connect is in progress, try again shortly
+        esp_timer_start_once(timer_handle_, 1000 * 1000);
+    }
+}
+
+// Runs in the WiFi event task, also for scans requested by the config portal that
+// this request joined
+void WifiStation::OnScanDone(const WifiScanService::Snapshot& results) {
+    if (!active_ || suspended_ || !scan_pending_.exchange(false)) {
+        return;   // Stopped meanwhile, or a duplicate completion after Resume()
+    }
+    xEventGroupSetBits(event_group_, WIFI_EVENT_SCAN_DONE_BIT);
+    pending_scan_ms_ = (esp_timer_get_time() - scan_start_us_) / 1000;
+    HandleScanResult(results);
+}
+
+void WifiStation::Suspend() {
+    // Also cancels a Resume() the event task has not handled yet
+    resume_pending_ = false;
+    if (!active_ || suspended_) {
+        return;
+    }
+    ESP_LOGI(TAG, "Suspending station");
+    suspended_ = true;
+    esp_timer_stop(timer_handle_);
+    scan_pending_ = false;
+
+    bool was_connected = was_connected_;
+    was_connected_ = false;
+    xEventGroupClearBits(event_group_, WIFI_EVENT_CONNECTED | WIFI_EVENT_SUSPENDED_BIT);
+    // Wait for the driver to report the disconnect, otherwise it reaches whoever
+    // borrows the STA interface next as if their own attempt had failed
+    wifi_ap_record_t ap_info;
+    bool associated = esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK;
+    esp_wifi_disconnect();
+    if (associated) {
+        auto bits = xEventGroupWaitBits(event_group_, WIFI_EVENT_SUSPENDED_BIT, pdTRUE, pdFALSE,
+                                        pdMS_TO_TICKS(SUSPEND_DISCONNECT_TIMEOUT_MS));
+        if ((bits & WIFI_EVENT_SUSPENDED_BIT) == 0) {
+            ESP_LOGW(TAG, "No disconnect event within %d ms", SUSPEND_DISCONNECT_TIMEOUT_MS);
+        }
+    }
+    if (was_connected && on_disconnected_) {
+        on_disconnected_(WIFI_REASON_ASSOC_LEAVE);
+    }
+}
+
+void WifiStation::Resume() {
+    if (!active_ || !suspended_ || resume_pending_.exchange(true)) {
+        return;
+    }
+    // Queued behind the borrower's last disconnect, so the station never takes
+    // it for its own; connect_queue_ is then only touched on the event task
+    esp_event_post(WIFI_STATION_EVENT, WIFI_STATION_EVENT_RESUME, nullptr, 0, portMAX_DELAY);
+}
+
+void WifiStation::ResumeEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    auto* this_ = static_cast<WifiStation*>(arg);
+    if (!this_->active_ || !this_->resume_pending_.exchange(false)) {
+        return;
+    }
+    ESP_LOGI(TAG, "Resuming station");
+    this_->connect_queue_.clear();
+    this_->suspended_ = false;
+    this_->reconnect_count_ = 0;
+    this_->scan_current_interval_microseconds_ = this_->scan_min_interval_microseconds_;
+    this_->OnStarted();
 }
 
 bool WifiStation::WaitForConnected(int timeout_ms) {
@@ -161,41 +304,80 @@ bool WifiStation::WaitForConnected(int timeout_ms) {
     return (bits & WIFI_EVENT_CONNECTED) != 0;
 }
 
-void WifiStation::HandleScanResult() {
-    uint16_t ap_num = 0;
-    esp_wifi_scan_get_ap_num(&ap_num);
-    wifi_ap_record_t *ap_records = (wifi_ap_record_t *)malloc(ap_num * sizeof(wifi_ap_record_t));
-    esp_wifi_scan_get_ap_records(&ap_num, ap_records);
-    // sort by rssi descending
-    std::sort(ap_records, ap_records + ap_num, [](const wifi_ap_record_t& a, const wifi_ap_record_t& b) {
-        return a.rssi > b.rssi;
+// Connect straight to the AP of the last successful session, skipping the scan
+bool WifiStation::TryFastConnect() {
+    if (!fast_reconnect_ || last_ap_.ssid[0] == '\0' || last_ap_.channel == 0) {
+        return false;
+    }
+
+    auto ssid_list = SsidManager::GetInstance().GetSsidList();
+    auto it = std::find_if(ssid_list->begin(), ssid_list->end(), [this](const SsidItem& item) {
+        return item.ssid == last_ap_.ssid;
     });
+    if (it == ssid_list->end()) {
+        return false;
+    }
 
-    auto& ssid_manager = SsidManager::GetInstance();
-    auto ssid_list = ssid_manager.GetSsidList();
+    ESP_LOGI(TAG, "Fast connect to %s, BSSID: %02x:%02x:%02x:%02x:%02x:%02x, Channel: %d", last_ap_.ssid,
+        last_ap_.bssid[0], last_ap_.bssid[1], last_ap_.bssid[2],
+        last_ap_.bssid[3], last_ap_.bssid[4], last_ap_.bssid[5], last_ap_.channel);
+    WifiApRecord record = {
+        .ssid = it->ssid,
+        .password = it->password,
+        .channel = last_ap_.channel,
+        .authmode = (wifi_auth_mode_t)last_ap_.authmode,
+        .bssid = {0},
+        .rssi = 0
+    };
+    memcpy(record.bssid, last_ap_.bssid, 6);
+    connect_queue_.clear();
+    connect_queue_.push_back(record);
+    fast_connect_attempt_ = true;
+    StartConnect();
+    return true;
+}
+
+void WifiStation::HandleScanResult(const WifiScanService::Snapshot& results) {
+    fast_connect_attempt_ = false;
+    // A failed scan is handled like an empty one: retry after the backoff interval
+    const wifi_ap_record_t* ap_records = results ? results->records.data() : nullptr;
+    int ap_num = results ? results->records.size() : 0;
+    // Snapshot stays valid even if the portal edits the list meanwhile
+    auto ssid_list = SsidManager::GetInstance().GetSsidList();
+
+    // Rank by RSSI adjusted with connection history, band and channel congestion
+    std::vector<std::pair<int, WifiApRecord>> ranked;
     for (int i = 0; i < ap_num; i++) {
-        auto ap_record = ap_records[i];
-        auto it = std::find_if(ssid_list.begin(), ssid_list.end(), [ap_record](const SsidItem& item) {
-            return strcmp((char *)ap_record.ssid, item.ssid.c_str()) == 0;
+        const auto& ap_record = ap_records[i];
+        auto it = std::find_if(ssid_list->begin(), ssid_list->end(), [&ap_record](const SsidItem& item) {
+            return item.ssid == (const char *)ap_record.ssid;
         });
-        if (it != ssid_list.end()) {
-            ESP_LOGI(TAG, "Found AP: %s, BSSID: %02x:%02x:%02x:%02x:%02x:%02x, RSSI: %d, Channel: %d, Authmode: %d",
+        if (it != ssid_list->end()) {
+            int score = selector_.Score(ap_record, ap_records, ap_num);
+            ESP_LOGI(TAG, "Found AP: %s, BSSID: %02x:%02x:%02x:%02x:%02x:%02x, RSSI: %d, Channel: %d, Authmode: %d, Score: %d",
                 (char *)ap_record.ssid, 
                 ap_record.bssid[0], ap_record.bssid[1], ap_record.bssid[2],
                 ap_record.bssid[3], ap_record.bssid[4], ap_record.bssid[5],
-                ap_record.rssi, ap_record.primary, ap_record.authmode);
+                ap_record.rssi, ap_record.primary, ap_record.authmode, score);
             WifiApRecord record = {
                 .ssid = it->ssid,
                 .password = it->password,
                 .channel = ap_record.primary,
                 .authmode = ap_record.authmode,
-                .bssid = {0}
+                .bssid = {0},
+                .rssi = ap_record.rssi
             };
             memcpy(record.bssid, ap_record.bssid, 6);
-            connect_queue_.push_back(record);
+            ranked.emplace_back(score, std::move(record));
         }
     }
-    free(ap_records);
+
+    std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return a.first > b.first;
+    });
+    for (auto& entry : ranked) {
+        connect_queue_.push_back(std::move(entry.second));
+    }
 
     if (connect_queue_.empty()) {
         ESP_LOGI(TAG, "No AP found, next scan in %d seconds", scan_current_interval_microseconds_ / 1000 / 1000);
@@ -212,6 +394,7 @@ void WifiStation::StartConnect() {
     connect_queue_.erase(connect_queue_.begin());
     ssid_ = ap_record.ssid;
     password_ = ap_record.password;
+    memcpy(bssid_, ap_record.bssid, 6);
 
     if (on_connect_) {
         on_connect_(ssid_);
@@ -219,20 +402,108 @@ void WifiStation::StartConnect() {
 
     wifi_config_t wifi_config;
     bzero(&wifi_config, sizeof(wifi_config));
-    strcpy((char *)wifi_config.sta.ssid, ap_record.ssid.c_str());
-    strcpy((char *)wifi_config.sta.password, ap_record.password.c_str());
-    if (remember_bssid_) {
+    memcpy(wifi_config.sta.ssid, ap_record.ssid.data(), ap_record.ssid.size());
+    memcpy(wifi_config.sta.password, ap_record.password.data(), ap_record.password.size());
+    if (remember_bssid_ || fast_connect_attempt_) {
         wifi_config.sta.channel = ap_record.channel;
         memcpy(wifi_config.sta.bssid, ap_record.bssid, 6);
         wifi_config.sta.bssid_set = true;
     }
-    wifi_config.sta.listen_interval = 10;
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    wifi_config.sta.listen_interval = listen_interval_;
+    // H2E derives the SAE password element once per network instead of on every
+    // association, which is the expensive part of WPA3 on single-core parts
+    wifi_config.sta.sae_pwe_h2e = WPA3_SAE_PWE_BOTH;
+    config_reused_ = ApplyStaConfig(wifi_config);
 
     reconnect_count_ = 0;
+    attempt_scan_ms_ = pending_scan_ms_;
+    pending_scan_ms_ = 0;
+    BeginAttempt();
     ESP_ERROR_CHECK(esp_wifi_connect());
 }
 
+// Only touch the STA config when it changes: esp_wifi_set_config() drops the
+// supplicant's PMKSA cache, forcing a full 4-way/SAE handshake on the next connect
+bool WifiStation::ApplyStaConfig(wifi_config_t& config) {
+    wifi_config_t current = {};
+    if (esp_wifi_get_config(WIFI_IF_STA, &current) == ESP_OK &&
+        strncmp((const char*)current.sta.ssid, (const char*)config.sta.ssid, sizeof(config.sta.ssid)) == 0 &&
+        strncmp((const char*)current.sta.password, (const char*)config.sta.password, sizeof(config.sta.password)) == 0 &&
+        current.sta.bssid_set == config.sta.bssid_set &&
+        (!config.sta.bssid_set || memcmp(current.sta.bssid, config.sta.bssid, 6) == 0) &&
+        current.sta.channel == config.sta.channel &&
+        current.sta.listen_interval == config.sta.listen_interval &&
+        current.sta.sae_pwe_h2e == config.sta.sae_pwe_h2e) {
+        return true;
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &config));
+    return false;
+}
+
+void WifiStation::RememberAssociation() {
+    if (!WasAssociated(bssid_)) {
+        int slot = associated_bssid_count_ % kMaxAssociatedBssids;
+        memcpy(associated_bssids_[slot], bssid_, 6);
+        associated_bssid_count_++;
+    }
+
+    // Persist the AP for the next boot, only when it changed to spare NVS writes
+    if (!fast_reconnect_ || (strcmp(last_ap_.ssid, ssid_.c_str()) == 0 &&
+        memcmp(last_ap_.bssid, bssid_, 6) == 0 && last_ap_.channel == channel_ &&
+        last_ap_.authmode == authmode_)) {
+        return;
+    }
+    strlcpy(last_ap_.ssid, ssid_.c_str(), sizeof(last_ap_.ssid));
+    memcpy(last_ap_.bssid, bssid_, 6);
+    last_ap_.channel = channel_;
+    last_ap_.authmode = authmode_;
+    nvs_handle_t nvs;
+    if (nvs_open("wifi", NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_set_blob(nvs, "last_ap", &last_ap_, sizeof(last_ap_));
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
+
+bool WifiStation::WasAssociated(const uint8_t bssid[6]) const {
+    int count = std::min(associated_bssid_count_, kMaxAssociatedBssids);
+    for (int i = 0; i < count; i++) {
+        if (memcmp(associated_bssids_[i], bssid, 6) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WifiStation::BeginAttempt() {
+    connect_start_us_ = esp_timer_get_time();
+    associated_us_ = 0;
+}
+
+void WifiStation::FinishAttempt(bool success, uint8_t reason) {
+    if (!on_attempt_finished_) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    WifiConnectAttempt attempt = {};
+    attempt.timestamp_us = connect_start_us_;
+    strlcpy(attempt.ssid, ssid_.c_str(), sizeof(attempt.ssid));
+    memcpy(attempt.bssid, bssid_, 6);
+    attempt.scan_ms = attempt_scan_ms_;
+    if (associated_us_ != 0) {
+        attempt.assoc_ms = (associated_us_ - connect_start_us_) / 1000;
+        if (success) {
+            attempt.dhcp_ms = (now - associated_us_) / 1000;
+        }
+    }
+    attempt.disconnect_reason = reason;
+    attempt.reconnects = reconnect_count_;
+    attempt.success = success;
+    attempt.cached_credentials = config_reused_ && WasAssociated(bssid_);
+    attempt_scan_ms_ = 0;
+    on_attempt_finished_(attempt);
+}
+
 int8_t WifiStation::GetRssi() {
     // Check if connected first
     if (!IsConnected()) {
@@ -308,47 +579,87 @@ void WifiStation::UpdateScanInterval() {
 // Static event handler functions
 void WifiStation::WifiEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
     auto* this_ = static_cast<WifiStation*>(arg);
-    if (event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_scan_start(nullptr, false);
-        if (this_->on_scan_begin_) {
-            this_->on_scan_begin_();
+    // While suspended the events belong to whoever borrowed the STA interface,
+    // except the disconnect Suspend() is waiting for
+    if (!this_->active_) {
+        return;
+    }
+    if (this_->suspended_) {
+        if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+            xEventGroupSetBits(this_->event_group_, WIFI_EVENT_SUSPENDED_BIT);
         }
-    } else if (event_id == WIFI_EVENT_SCAN_DONE) {
-        xEventGroupSetBits(this_->event_group_, WIFI_EVENT_SCAN_DONE_BIT);
-        this_->HandleScanResult();
+        return;
+    }
+    if (event_id == WIFI_EVENT_STA_START) {
+        this_->OnStarted();
     } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        auto* event = static_cast<wifi_event_sta_disconnected_t*>(event_data);
         xEventGroupClearBits(this_->event_group_, WIFI_EVENT_CONNECTED);
         
         // Notify disconnected callback only once when transitioning from connected to disconnected
         bool was_connected = this_->was_connected_;
         this_->was_connected_ = false;
-        if (was_connected && this_->on_disconnected_) {
-            ESP_LOGI(TAG, "WiFi disconnected, notifying callback");
-            this_->on_disconnected_();
+        if (was_connected) {
+            ESP_LOGI(TAG, "WiFi disconnected from %s, reason %d", this_->ssid_.c_str(), event->reason);
+            ApHistory::GetInstance().RecordDisconnect(this_->ssid_, this_->bssid_);
+            if (this_->on_disconnected_) {
+                this_->on_disconnected_(event->reason);
+            }
+        } else {
+            ESP_LOGI(TAG, "Connect to %s failed, reason %d", this_->ssid_.c_str(), event->reason);
+            this_->FinishAttempt(false, event->reason);
         }
         
-        if (this_->reconnect_count_ < MAX_RECONNECT_COUNT) {
-            esp_wifi_connect();
+        int max_retries = this_->fast_connect_attempt_ ? FAST_CONNECT_RETRY_COUNT : MAX_RECONNECT_COUNT;
+        if (this_->reconnect_count_ < max_retries) {
             this_->reconnect_count_++;
-            ESP_LOGI(TAG, "Reconnecting %s (attempt %d / %d)", this_->ssid_.c_str(), this_->reconnect_count_, MAX_RECONNECT_COUNT);
+            this_->config_reused_ = true;  // Retries keep the config, PMK cache stays valid
+            this_->BeginAttempt();
+            esp_wifi_connect();
+            ESP_LOGI(TAG, "Reconnecting %s (attempt %d / %d)", this_->ssid_.c_str(), this_->reconnect_count_, max_retries);
             return;
         }
 
+        // Giving up on this AP, remember it as unreliable
+        auto& history = ApHistory::GetInstance();
+        history.RecordFailure(this_->ssid_, this_->bssid_);
+        history.Save();
+
         if (!this_->connect_queue_.empty()) {
             this_->StartConnect();
             return;
         }
+
+        if (this_->fast_connect_attempt_) {
+            // Last known AP is gone, scan right away instead of waiting for the timer
+            ESP_LOGI(TAG, "Fast connect failed, scanning");
+            this_->fast_connect_attempt_ = false;
+            this_->StartScan();
+            if (this_->on_scan_begin_) {
+                this_->on_scan_begin_();
+            }
+            return;
+        }
         
         ESP_LOGI(TAG, "No more AP to connect, next scan in %d seconds", 
                  this_->scan_current_interval_microseconds_ / 1000 / 1000);
         esp_timer_start_once(this_->timer_handle_, this_->scan_current_interval_microseconds_);
         this_->UpdateScanInterval();
     } else if (event_id == WIFI_EVENT_STA_CONNECTED) {
+        auto* event = static_cast<wifi_event_sta_connected_t*>(event_data);
+        // The driver may pick another BSSID of the same SSID when BSSID is not fixed
+        memcpy(this_->bssid_, event->bssid, 6);
+        this_->channel_ = event->channel;
+        this_->authmode_ = event->authmode;
+        this_->associated_us_ = esp_timer_get_time();
     }
 }
 
 void WifiStation::IpEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
     auto* this_ = static_cast<WifiStation*>(arg);
+    if (!this_->active_ || this_->suspended_) {
+        return;
+    }
     auto* event = static_cast<ip_event_got_ip_t*>(event_data);
 
     char ip_address[16];
@@ -356,6 +667,16 @@ void WifiStation::IpEventHandler(void* arg, esp_event_base_t event_base, int32_t
     this_->ip_address_ = ip_address;
     ESP_LOGI(TAG, "Got IP: %s", this_->ip_address_.c_str());
     
+    int64_t now = esp_timer_get_time();
+    int64_t associated_us = this_->associated_us_ != 0 ? this_->associated_us_ : now;
+    auto& history = ApHistory::GetInstance();
+    history.RecordSuccess(this_->ssid_, this_->bssid_,
+                          (associated_us - this_->connect_start_us_) / 1000,
+                          (now - associated_us) / 1000);
+    history.Save();
+    this_->FinishAttempt(true, 0);
+    this_->RememberAssociation();
+
     xEventGroupSetBits(this_->event_group_, WIFI_EVENT_CONNECTED);
     this_->was_connected_ = true;  // Mark as connected for disconnect notification
     if (this_->on_connected_) {
@@ -363,6 +684,8 @@ void WifiStation::IpEventHandler(void* arg, esp_event_base_t event_base, int32_t
     }
     this_->connect_queue_.clear();
     this_->reconnect_count_ = 0;
+    // The fast connect succeeded; a later link drop is an ordinary reconnect
+    this_->fast_connect_attempt_ = false;
     
     // Reset scan interval to minimum for fast reconnect if disconnected later
     this_->scan_current_interval_microseconds_ = this_->scan_min_interval_microseconds_;
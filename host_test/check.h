@@ -0,0 +1,23 @@
+#ifndef _HOST_TEST_CHECK_H_
+#define _HOST_TEST_CHECK_H_
+
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal assertions: a failed CHECK is reported and makes main() return 1
+static int check_failures = 0;
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            check_failures++;                                                   \
+        }                                                                       \
+    } while (0)
+
+static int CheckResult(const char* name) {
+    printf("%s: %s\n", name, check_failures == 0 ? "OK" : "FAILED");
+    return check_failures == 0 ? 0 : 1;
+}
+
+#endif // _HOST_TEST_CHECK_H_
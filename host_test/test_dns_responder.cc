@@ -0,0 +1,115 @@
+// DnsResponder: hand-made queries with known answers, then random and mutated
+// datagrams that must never produce a response longer than the buffer
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "dns_responder.h"
+#include "check.h"
+
+static const uint8_t kGateway[4] = {192, 168, 4, 1};
+
+static std::vector<uint8_t> Query(const std::vector<std::string>& labels, uint16_t qtype, uint16_t qclass = 1) {
+    std::vector<uint8_t> query = {0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    for (const auto& label : labels) {
+        query.push_back(static_cast<uint8_t>(label.size()));
+        query.insert(query.end(), label.begin(), label.end());
+    }
+    query.push_back(0);
+    query.insert(query.end(), {uint8_t(qtype >> 8), uint8_t(qtype), uint8_t(qclass >> 8), uint8_t(qclass)});
+    return query;
+}
+
+static int Build(const DnsResponder& responder, const std::vector<uint8_t>& query, uint8_t* response, int size = 512) {
+    return responder.BuildResponse(query.data(), static_cast<int>(query.size()), response, size);
+}
+
+int main() {
+    DnsResponder responder;
+    uint32_t gateway;
+    memcpy(&gateway, kGateway, 4);
+    responder.SetGateway(gateway);
+    uint8_t response[512];
+
+    // A: header and question echoed, one answer with the gateway address
+    auto a = Query({"connectivitycheck", "gstatic", "com"}, 1);
+    int len = Build(responder, a, response);
+    CHECK(len == static_cast<int>(a.size()) + 16);
+    CHECK(response[0] == 0x12 && response[1] == 0x34);
+    CHECK(response[2] == 0x85 && response[3] == 0x80);   // QR, AA, RD echoed; RA, NOERROR
+    CHECK(response[7] == 1);
+    CHECK(memcmp(response + a.size() + 12, kGateway, 4) == 0);
+
+    // AAAA and HTTPS: NOERROR without an answer
+    for (uint16_t qtype : {28, 65}) {
+        auto q = Query({"captive", "apple", "com"}, qtype);
+        CHECK(Build(responder, q, response) == static_cast<int>(q.size()));
+        CHECK(response[7] == 0);
+    }
+    // ANY is answered like A, another class is not
+    CHECK(Build(responder, Query({"a"}, 255), response) > 0 && response[7] == 1);
+    CHECK(Build(responder, Query({"a"}, 1, 3), response) > 0 && response[7] == 0);
+
+    // Truncated datagrams are dropped
+    for (size_t cut : {0, 5, 11, 12, 20, 30}) {
+        if (cut < a.size()) {
+            CHECK(responder.BuildResponse(a.data(), static_cast<int>(cut), response, sizeof(response)) == -1);
+        }
+    }
+    // QR set, another opcode, two questions
+    auto bad = a;
+    bad[2] |= 0x80;
+    CHECK(Build(responder, bad, response) == -1);
+    bad = a;
+    bad[2] |= 0x10;
+    CHECK(Build(responder, bad, response) == -1);
+    bad = a;
+    bad[5] = 2;
+    CHECK(Build(responder, bad, response) == -1);
+    // Compression pointer in the question, 64-byte label, 300-byte name
+    bad = a;
+    bad[12] = 0xc0;
+    CHECK(Build(responder, bad, response) == -1);
+    CHECK(Build(responder, Query({std::string(64, 'x')}, 1), response) == -1);
+    CHECK(Build(responder, Query(std::vector<std::string>(5, std::string(59, 'x')), 1), response) == -1);
+    // 253 characters, the longest legal name, is answered
+    auto longest = Query({std::string(63, 'x'), std::string(63, 'x'), std::string(63, 'x'), std::string(61, 'x')}, 1);
+    CHECK(Build(responder, longest, response) == static_cast<int>(longest.size()) + 16);
+    // Response buffer too small for the answer
+    CHECK(Build(responder, a, response, static_cast<int>(a.size()) + 15) == -1);
+    // Trailing EDNS OPT record is not echoed
+    auto edns = a;
+    edns[11] = 1;
+    edns.insert(edns.end(), {0x00, 0x00, 0x29, 0x04, 0xd0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
+    CHECK(Build(responder, edns, response) == static_cast<int>(a.size()) + 16);
+    CHECK(response[11] == 0);
+
+    // Fuzz: random bytes, and valid queries with a few bytes flipped or cut short
+    std::mt19937 rng(45);
+    std::vector<uint8_t> datagram;
+    for (int i = 0; i < 200000; i++) {
+        if (i % 2 == 0) {
+            datagram.resize(rng() % 600);
+            for (auto& byte : datagram) {
+                byte = static_cast<uint8_t>(rng());
+            }
+            if (datagram.size() > 5) {
+                datagram[2] &= 0x07;   // Mostly past the header checks
+                datagram[4] = 0;
+                datagram[5] = 1;
+            }
+        } else {
+            datagram = (i % 4 == 1) ? a : longest;
+            for (int flips = 1 + rng() % 4; flips > 0; flips--) {
+                datagram[rng() % datagram.size()] = static_cast<uint8_t>(rng());
+            }
+            datagram.resize(rng() % (datagram.size() + 1));
+        }
+        int size = 12 + static_cast<int>(rng() % 500);
+        std::vector<uint8_t> out(size);
+        int n = responder.BuildResponse(datagram.data(), static_cast<int>(datagram.size()), out.data(), size);
+        CHECK(n == -1 || (n >= 12 && n <= size));
+    }
+
+    return CheckResult("dns_responder");
+}
@@ -0,0 +1,81 @@
+// FixedString: inline storage, so copies made under a mutex or into event
+// payloads never touch the heap; counted here with a replaced operator new
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "fixed_string.h"
+#include "check.h"
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// What SsidManager hands out per saved network
+struct Item {
+    SsidString ssid;
+    PasswordString password;
+};
+
+static Item Get(const Item& item) {
+    return item;
+}
+
+int main() {
+    Item saved{SsidString("A network name of 32 bytes long!"), PasswordString("a passphrase longer than the 15 bytes SSO keeps inline")};
+
+    size_t before = allocations;
+    for (int i = 0; i < 1000; i++) {
+        Item copy = Get(saved);
+        SsidString ssid = copy.ssid;
+        CHECK(ssid == saved.ssid);
+    }
+    CHECK(allocations == before);
+
+    // Assignment and comparison against string_view / const char* don't allocate either
+    before = allocations;
+    SsidString ssid;
+    ssid = "Cafe";
+    CHECK(ssid == "Cafe");
+    CHECK(ssid != std::string_view("Cafe 5G"));
+    CHECK(ssid.size() == 4 && ssid.c_str()[4] == '\0');
+    CHECK(allocations == before);
+
+    // Longer input is truncated at the capacity and reported
+    SsidString truncated;
+    CHECK(!truncated.assign(std::string(40, 'x')));
+    CHECK(truncated.size() == SsidString::capacity());
+    CHECK(truncated.c_str()[SsidString::capacity()] == '\0');
+    CHECK(truncated.assign(std::string(32, 'y')));
+
+    // Self-overlapping assignment (memmove)
+    UrlString url("http://192.168.4.1/ota");
+    url = url.view().substr(7);
+    CHECK(url == "192.168.4.1/ota");
+
+    // The same copies with std::string allocate: the baseline this replaced
+    struct StdItem {
+        std::string ssid;
+        std::string password;
+    };
+    StdItem std_saved{saved.ssid.str(), saved.password.str()};
+    before = allocations;
+    for (int i = 0; i < 10; i++) {
+        StdItem copy = std_saved;
+        CHECK(copy.ssid.size() == 32);
+    }
+    CHECK(allocations > before);
+
+    return CheckResult("fixed_string");
+}
@@ -39,6 +39,8 @@ void init_wifi(void){
     // Cấu hình tiền tố cho tên trạm phát WiFi (AP)
     WifiManagerConfig config;
     config.ssid_prefix = "KHOA-WIFI"; // Tên AP sẽ là KHOA-WIFI_XXXX
+    // Giữ kết nối WiFi (dữ liệu, OTA) trong lúc mở trang cấu hình
+    config.concurrent_config_ap = true;
     manager.Initialize(config);
 
     // Đăng ký Callback lắng nghe các sự kiện WiFi
@@ -59,14 +61,24 @@ void init_wifi(void){
         }
     });
 
+    // Tắt power save WiFi trong lúc OTA tải firmware
+    OtaManager::GetInstance().SetTransferCallback([](bool active) {
+        auto& wifi = WifiManager::GetInstance();
+        if (active) {
+            wifi.BeginTransfer();
+        } else {
+            wifi.EndTransfer();
+        }
+    });
+
     // Kiểm tra danh sách WiFi đã lưu trong bộ nhớ
-    auto& ssid_list = SsidManager::GetInstance().GetSsidList();
+    auto ssid_list = SsidManager::GetInstance().GetSsidList();
 
-    if (ssid_list.empty()) {
+    if (ssid_list->empty()) {
         ESP_LOGW(TAG, "Chua co WiFi nao duoc luu. Bat che do AP...");
         manager.StartConfigAp();
     } else {
-        ESP_LOGI(TAG, "Tim thay WiFi da luu: %s. Dang ket noi...", ssid_list[0].ssid.c_str());
+        ESP_LOGI(TAG, "Tim thay WiFi da luu: %s. Dang ket noi...", (*ssid_list)[0].ssid.c_str());
         manager.StartStation();
     }
 
@@ -6,7 +6,7 @@ import os
 import argparse
 from typing import Optional
 from pathlib import Path
-from app.utils import log_info, log_warning, find_firmware, read_project_version
+from app.utils import log_info, log_warning, find_firmware, read_project_version, find_asset_bundle, read_bundle_version
 
 class AppConfig:
     def __init__(self):
@@ -17,6 +17,8 @@ class AppConfig:
         
         self.firmware_path: Optional[str] = os.environ.get("OTA_FIRMWARE")
         self.firmware_dir: str = os.environ.get("OTA_FIRMWARE_DIR", "/firmware")
+        # Asset bundle giao diện web (gen_portal_assets.py --bundle), cập nhật không cần firmware mới
+        self.assets_path: Optional[str] = os.environ.get("OTA_ASSETS")
         
         # Đường dẫn dữ liệu
         self.data_dir: str = os.environ.get("OTA_DATA_DIR", "/data")
@@ -43,7 +45,15 @@ class AppConfig:
                         self.firmware_dir = os.path.abspath(search)
                         break
 
-        # 2. Tìm Version từ CMakeLists.txt nếu chưa có
+        # 2. Tìm asset bundle cạnh firmware
+        if self.assets_path and os.path.isfile(self.assets_path):
+            self.assets_path = os.path.abspath(self.assets_path)
+        else:
+            self.assets_path = find_asset_bundle(self.firmware_dir) if self.firmware_dir else None
+        if self.assets_path:
+            log_info(f"Asset bundle: {os.path.basename(self.assets_path)} (v{read_bundle_version(self.assets_path)})")
+
+        # 3. Tìm Version từ CMakeLists.txt nếu chưa có
         if self.ota_version == "0.0.0":
             search_dir = self.firmware_dir or '.'
             auto_ver = read_project_version(search_dir)
@@ -58,12 +68,14 @@ class AppConfig:
         parser.add_argument('--bind', '-b', type=str, help='Bind address')
         parser.add_argument('--firmware', '-f', type=str, help='Path to firmware .bin')
         parser.add_argument('--version', '-v', type=str, help='Firmware version')
+        parser.add_argument('--assets', '-a', type=str, help='Path to asset bundle .bin')
         
         args, _ = parser.parse_known_args()
         if args.port: self.port = args.port
         if args.bind: self.bind = args.bind
         if args.firmware: self.firmware_path = os.path.abspath(args.firmware)
         if args.version: self.ota_version = args.version
+        if args.assets: self.assets_path = os.path.abspath(args.assets)
 
     def get_public_url(self) -> str:
         if self.base_url:
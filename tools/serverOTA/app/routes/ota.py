@@ -12,7 +12,7 @@ from app.devices import (
     pending_devices, version_clients, active_downloads, stats,
     async_save_devices
 )
-from app.utils import Colors, format_size, log_esp_info, log_success, log_warning, log_error
+from app.utils import Colors, format_size, log_esp_info, log_success, log_warning, log_error, read_bundle_version
 
 router = APIRouter()
 
@@ -61,11 +61,21 @@ async def handle_check_version(request: Request):
     if is_approved and needs_update and config.firmware_path:
         fw_url = f"{config.get_public_url()}/{os.path.basename(config.firmware_path)}"
 
-    log_esp_info(f"🔍 [#{stats['version_check_count']}] {client_ip} ({mac}) v{device_version} -> v{config.ota_version} | {'OK' if fw_url else 'SKIP'}")
+    # Giao diện web: chỉ gửi bundle khi mới hơn bản thiết bị đang có
+    assets_url = ""
+    assets_version = read_bundle_version(config.assets_path) if config.assets_path else None
+    try: device_assets = int(body.get("assets", 0) or 0)
+    except (TypeError, ValueError): device_assets = 0
+    if is_approved and not fw_url and assets_version and assets_version > device_assets:
+        assets_url = f"{config.get_public_url()}/{os.path.basename(config.assets_path)}"
+
+    log_esp_info(f"🔍 [#{stats['version_check_count']}] {client_ip} ({mac}) v{device_version} -> v{config.ota_version} | {'OK' if fw_url else 'SKIP'}"
+                 + (f" | assets v{device_assets} -> v{assets_version}" if assets_url else ""))
 
     return {
         "version": config.ota_version,
-        "firmware": {"version": config.ota_version, "url": fw_url, "force": 0}
+        "firmware": {"version": config.ota_version, "url": fw_url, "force": 0},
+        "assets": {"version": assets_version or 0, "url": assets_url}
     }
 
 @router.get("/firmware.bin")
@@ -128,6 +138,8 @@ async def serve_firmware_by_name(filename: str, request: Request):
     target = None
     if config.firmware_path and os.path.basename(config.firmware_path) == filename:
         target = config.firmware_path
+    elif config.assets_path and os.path.basename(config.assets_path) == filename:
+        target = config.assets_path
     elif config.firmware_dir:
         path = os.path.join(config.firmware_dir, filename)
         if os.path.isfile(path): target = path
@@ -5,6 +5,7 @@ Utils module - Hàm tiện ích: log, format, tìm firmware
 import os
 import re
 import socket
+import struct
 import hashlib
 from pathlib import Path
 from datetime import datetime
@@ -87,10 +88,31 @@ def find_firmware(build_dir):
     bin_files = list(Path(build_dir).glob('*.bin'))
     app_bins = [f for f in bin_files if 'bootloader' not in f.name
                 and 'partition' not in f.name
-                and 'ota_data' not in f.name]
+                and 'ota_data' not in f.name
+                and read_bundle_version(str(f)) is None]
     return str(app_bins[0]) if app_bins else None
 
 
+def read_bundle_version(filepath):
+    """Version trong header asset bundle (gen_portal_assets.py --bundle), None nếu không phải bundle"""
+    try:
+        with open(filepath, 'rb') as f:
+            header = f.read(12)
+    except OSError:
+        return None
+    if len(header) < 12 or header[:4] != b'KPAB':
+        return None
+    return struct.unpack_from('<I', header, 8)[0]
+
+
+def find_asset_bundle(search_dir):
+    """Tìm asset bundle giao diện web (.bin có magic KPAB)"""
+    if not os.path.isdir(search_dir):
+        return None
+    bundles = [f for f in Path(search_dir).glob('*.bin') if read_bundle_version(str(f)) is not None]
+    return str(bundles[0]) if bundles else None
+
+
 def read_project_version(search_dir):
     """Đọc PROJECT_VER từ CMakeLists.txt"""
     for parent in [Path(search_dir).parent, Path(search_dir).parent.parent, Path('.')]: